@@ -0,0 +1,268 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+#include "covariance_engine.h"
+
+/**
+ * @brief Projects a vector onto the capped simplex {w : sum(w) = 1, 0 <= w_i <= upper_i}.
+ *
+ * Finds the shift tau such that the clipped values clip(v_i - tau, 0, upper_i)
+ * add up to 1, by bisection. Requires sum(upper) >= 1.
+ *
+ * @param values The vector to project, overwritten with the projection.
+ * @param upper The cap of each entry (0 excludes the entry).
+ */
+void project_capped_simplex(std::vector<double>& values, const std::vector<double>& upper) {
+    double low = std::numeric_limits<double>::max();
+    double high = std::numeric_limits<double>::lowest();
+    for (size_t i = 0; i < values.size(); ++i) {
+        low = std::min(low, values[i] - upper[i]);
+        high = std::max(high, values[i]);
+    }
+
+    // At tau = low every entry sits at its cap (sum >= 1), at tau = high every entry is 0
+    for (int step = 0; step < 100 && high - low > 1e-15; ++step) {
+        double tau = 0.5 * (low + high);
+        double sum = 0.0;
+        for (size_t i = 0; i < values.size(); ++i) {
+            sum += std::clamp(values[i] - tau, 0.0, upper[i]);
+        }
+        if (sum > 1.0) {
+            low = tau;
+        } else {
+            high = tau;
+        }
+    }
+
+    double tau = 0.5 * (low + high);
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = std::clamp(values[i] - tau, 0.0, upper[i]);
+    }
+}
+
+/**
+ * @struct Allocation_Optimizer
+ * @brief Solves long-only, capped portfolio allocation problems on an EWMA covariance matrix.
+ *
+ * Supported modes:
+ * - "min_variance": minimizes \f$w^T \Sigma w\f$.
+ * - "mean_variance": maximizes \f$\mu^T w - \frac{\gamma}{2} w^T \Sigma w\f$.
+ * - "risk_parity": equalizes the risk contributions \f$w_i (\Sigma w)_i\f$.
+ *
+ * Weights are long-only, add up to 1 and are capped at max_weight per ticker.
+ * Each call to solve warm-starts from the previous solution, so consecutive
+ * hours only need a few iterations.
+ */
+struct Allocation_Optimizer {
+    std::string mode = "min_variance";  // "min_variance", "mean_variance" or "risk_parity"
+    double risk_aversion = 50.0;        // gamma of the mean-variance objective
+    double max_weight = 0.25;           // Per-ticker cap (raised to 1/n if infeasible)
+    size_t max_iterations = 10;         // Iteration limit of each solve; the warm start carries convergence across hours
+    double tolerance = 1e-6;            // Stop when no weight moves more than this
+
+    std::vector<double> weights;        // Last solution, used as the warm start
+    std::vector<double> eigenvector;    // Warm start of the power iteration
+    size_t last_iterations = 0;         // Iterations used by the last solve
+
+    /**
+     * @brief Computes the target weights for the current covariance matrix.
+     *
+     * @param covariance The EWMA covariance matrix of the tickers' returns.
+     * @param expected_returns The expected return of each ticker (only used by "mean_variance").
+     * @param active Whether each ticker can be held; inactive tickers get a weight of 0.
+     * @return The target weight of each ticker, indexed like the covariance matrix.
+     */
+    const std::vector<double>& solve(const Ewma_Covariance& covariance,
+                                     const std::vector<double>& expected_returns,
+                                     const std::vector<bool>& active) {
+        const size_t n = covariance.size();
+        size_t n_active = std::count(active.begin(), active.end(), true);
+        last_iterations = 0;
+        if (n_active == 0) {
+            weights.assign(n, 0.0);
+            return weights;
+        }
+
+        // With too few tickers for the cap, raise it so the weights can still add up to 1
+        double cap = std::max(max_weight, 1.0 / n_active);
+        if (cap * n_active < 1.0) {
+            cap = std::nextafter(cap, 2.0);
+        }
+        std::vector<double> upper(n, 0.0);
+        for (size_t i = 0; i < n; ++i) {
+            if (active[i]) {
+                upper[i] = cap;
+            }
+        }
+
+        // Warm start from the previous solution, or from equal weights on the first call
+        if (weights.size() != n) {
+            weights.assign(n, 0.0);
+            for (size_t i = 0; i < n; ++i) {
+                weights[i] = active[i] ? 1.0 / n_active : 0.0;
+            }
+        }
+        project_capped_simplex(weights, upper);
+
+        if (mode == "risk_parity") {
+            solve_risk_parity(covariance, active, upper);
+        } else {
+            solve_projected_gradient(covariance, expected_returns, upper);
+        }
+        return weights;
+    }
+
+private:
+    // Estimates the largest eigenvalue of the covariance matrix by warm-started power iteration
+    double largest_eigenvalue(const Ewma_Covariance& covariance) {
+        const size_t n = covariance.size();
+        if (eigenvector.size() != n) {
+            eigenvector.assign(n, 1.0 / std::sqrt(static_cast<double>(n)));
+        }
+        std::vector<double>& product = scratch_product;
+        product.resize(n);
+        double eigenvalue = 0.0;
+        for (int step = 0; step < 5; ++step) {
+            covariance.multiply(eigenvector, product);
+            double norm = 0.0;
+            for (double value : product) {
+                norm += value * value;
+            }
+            norm = std::sqrt(norm);
+            if (norm <= 0.0) {
+                return 0.0;
+            }
+            eigenvalue = norm;
+            for (size_t i = 0; i < n; ++i) {
+                eigenvector[i] = product[i] / norm;
+            }
+        }
+        return eigenvalue;
+    }
+
+    // Accelerated projected gradient descent (FISTA) for the min-variance and mean-variance objectives
+    void solve_projected_gradient(const Ewma_Covariance& covariance,
+                                  const std::vector<double>& expected_returns,
+                                  const std::vector<double>& upper) {
+        const size_t n = covariance.size();
+        const bool mean_variance = mode == "mean_variance";
+        const double scale = mean_variance ? risk_aversion : 1.0;
+
+        // Step size 1/L, with a safety margin on the power iteration estimate
+        double lipschitz = 1.25 * scale * largest_eigenvalue(covariance);
+        if (lipschitz <= 0.0) {
+            return; // No risk information yet; keep the warm start
+        }
+        double step = 1.0 / lipschitz;
+
+        std::vector<double>& sigma_y = scratch_product;
+        std::vector<double>& y = scratch_point;
+        std::vector<double>& next = scratch_next;
+        sigma_y.resize(n);
+        y.assign(weights.begin(), weights.end());
+        next.resize(n);
+        double momentum = 1.0;
+        for (size_t iteration = 0; iteration < max_iterations; ++iteration) {
+            covariance.multiply(y, sigma_y);
+            for (size_t i = 0; i < n; ++i) {
+                double gradient = scale * sigma_y[i];
+                if (mean_variance && i < expected_returns.size()) {
+                    gradient -= expected_returns[i];
+                }
+                next[i] = y[i] - step * gradient;
+            }
+            project_capped_simplex(next, upper);
+
+            double next_momentum = 0.5 * (1.0 + std::sqrt(1.0 + 4.0 * momentum * momentum));
+            double extrapolation = (momentum - 1.0) / next_momentum;
+            double change = 0.0;
+            for (size_t i = 0; i < n; ++i) {
+                double delta = next[i] - weights[i];
+                change = std::max(change, std::abs(delta));
+                y[i] = next[i] + extrapolation * delta;
+            }
+            weights.swap(next);
+            momentum = next_momentum;
+            ++last_iterations;
+            if (change < tolerance) {
+                break;
+            }
+        }
+    }
+
+    // Cyclical coordinate descent on 0.5 w'Sw - sum(b log w) with equal budgets b,
+    // whose normalized minimizer has equal risk contributions
+    void solve_risk_parity(const Ewma_Covariance& covariance,
+                           const std::vector<bool>& active,
+                           const std::vector<double>& upper) {
+        const size_t n = covariance.size();
+        std::vector<double>& sigma_w = scratch_product;
+        std::vector<double>& covariance_row = scratch_point;
+        sigma_w.resize(n);
+        covariance.multiply(weights, sigma_w);
+        const double budget = 1.0 / std::count(active.begin(), active.end(), true);
+
+        // The unnormalized minimizer is the risk-parity portfolio divided by its volatility
+        double variance = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            variance += weights[i] * sigma_w[i];
+        }
+        if (variance > 0.0) {
+            double scale = 1.0 / std::sqrt(variance);
+            for (size_t i = 0; i < n; ++i) {
+                weights[i] *= scale;
+                sigma_w[i] *= scale;
+            }
+        }
+
+        for (size_t iteration = 0; iteration < max_iterations; ++iteration) {
+            double change = 0.0;
+            for (size_t i = 0; i < n; ++i) {
+                if (!active[i]) {
+                    continue;
+                }
+                double own_variance = covariance.covariance(i, i);
+                if (own_variance <= 0.0) {
+                    continue;
+                }
+                // Solve own_variance * w^2 + others * w - budget = 0 for the positive root
+                double others = sigma_w[i] - own_variance * weights[i];
+                double updated = (-others + std::sqrt(others * others + 4.0 * own_variance * budget)) / (2.0 * own_variance);
+                double delta = updated - weights[i];
+                if (delta == 0.0) {
+                    continue;
+                }
+                covariance.row(i, covariance_row);
+                for (size_t j = 0; j < n; ++j) {
+                    sigma_w[j] += covariance_row[j] * delta;
+                }
+                weights[i] = updated;
+                change = std::max(change, std::abs(delta) / updated);
+            }
+            ++last_iterations;
+            if (change < tolerance) {
+                break;
+            }
+        }
+
+        // Normalize to a fully invested portfolio and enforce the caps
+        double total = 0.0;
+        for (double weight : weights) {
+            total += weight;
+        }
+        if (total > 0.0) {
+            for (double& weight : weights) {
+                weight /= total;
+            }
+        }
+        project_capped_simplex(weights, upper);
+    }
+
+    // Scratch buffers, kept across solves so the iterations never allocate
+    std::vector<double> scratch_product;    // Covariance matrix times a vector
+    std::vector<double> scratch_point;      // Extrapolated point of FISTA, or a covariance row
+    std::vector<double> scratch_next;       // Next iterate of FISTA
+};
@@ -0,0 +1,382 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <utility> // For std::move
+#include <vector>
+#include "symbol_table.h"
+#include "simulation.h"
+
+/**
+ * @brief Binary checkpoints of a Simulation_State.
+ *
+ * A checkpoint holds the complete state of a simulation (holdings, volatility estimates,
+ * covariance matrix, optimizer warm start, execution costs, volatility sketches, performance metrics, last processed timestamp and
+ * the strategy parameters), so run_simulation can resume from it with exactly the results of a full replay.
+ * Values are stored in the machine's native byte order, and the price and volatility series in the
+ * build's Series_Value precision; the ticker symbols are stored too, so a checkpoint is only loaded
+ * for the same universe of tickers and the same precision.
+ */
+namespace Checkpoint {
+    constexpr std::uint32_t magic = 0x4B434D53;  // "SMCK"
+    constexpr std::uint32_t version = 5;
+
+    template <typename T>
+    void write_value(std::ostream& out, const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "write_value needs a trivially copyable type");
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    void write_vector(std::ostream& out, const std::vector<T>& values) {
+        write_value<std::uint64_t>(out, values.size());
+        out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    void write_string(std::ostream& out, const std::string& value) {
+        write_value<std::uint64_t>(out, value.size());
+        out.write(value.data(), value.size());
+    }
+
+    void write_sketch(std::ostream& out, const Quantile_Sketch& sketch) {
+        write_value<std::uint64_t>(out, sketch.k);
+        write_value<std::uint64_t>(out, sketch.n);
+        write_value(out, sketch.min_value);
+        write_value(out, sketch.max_value);
+        write_value<std::uint64_t>(out, sketch.compactions);
+        write_value<std::uint64_t>(out, sketch.levels.size());
+        for (const auto& level : sketch.levels) {
+            write_vector(out, level);
+        }
+    }
+
+    template <typename T>
+    bool read_value(std::istream& in, T& value) {
+        in.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return static_cast<bool>(in);
+    }
+
+    template <typename T>
+    bool read_vector(std::istream& in, std::vector<T>& values) {
+        std::uint64_t size = 0;
+        if (!read_value(in, size) || size > (1ull << 32)) {
+            return false;
+        }
+        values.resize(size);
+        in.read(reinterpret_cast<char*>(values.data()), size * sizeof(T));
+        return static_cast<bool>(in);
+    }
+
+    bool read_string(std::istream& in, std::string& value) {
+        std::uint64_t size = 0;
+        if (!read_value(in, size) || size > (1ull << 20)) {
+            return false;
+        }
+        value.resize(size);
+        in.read(&value[0], size);
+        return static_cast<bool>(in);
+    }
+
+    bool read_sketch(std::istream& in, Quantile_Sketch& sketch) {
+        std::uint64_t k = 0;
+        std::uint64_t n_levels = 0;
+        if (!read_value(in, k) || !read_value(in, sketch.n) || !read_value(in, sketch.min_value) ||
+            !read_value(in, sketch.max_value) || !read_value(in, sketch.compactions) ||
+            !read_value(in, n_levels) || n_levels == 0 || n_levels > 64) {
+            return false;
+        }
+        sketch.k = k;
+        sketch.levels.resize(n_levels);
+        for (auto& level : sketch.levels) {
+            if (!read_vector(in, level)) {
+                return false;
+            }
+        }
+        sketch.recount();
+        return true;
+    }
+}
+
+/**
+ * @brief Saves the state of a simulation to a checkpoint file.
+ *
+ * @param filename The checkpoint file, overwritten if it exists.
+ * @param state The simulation state.
+ * @param symbols The symbol table of the simulated tickers.
+ * @return Whether the checkpoint was written.
+ */
+bool save_checkpoint(const std::string& filename, const Simulation_State& state, const Symbol_Table& symbols) {
+    using namespace Checkpoint;
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Failed to open checkpoint file: " << filename << std::endl;
+        return false;
+    }
+
+    write_value(out, magic);
+    write_value(out, version);
+    write_value<std::uint32_t>(out, sizeof(Series_Value));
+
+    // Universe and strategy parameters
+    write_value<std::uint64_t>(out, symbols.size());
+    for (const auto& name : symbols.names) {
+        write_string(out, name);
+    }
+    write_string(out, state.strategy);
+    write_string(out, state.manager.allocation_mode);
+    write_value(out, state.lambda);
+    write_value<std::uint64_t>(out, state.warmup_bars);
+    write_value(out, state.initial_investment);
+    write_string(out, state.threshold_mode);
+    write_value(out, state.threshold_quantiles);
+    write_value<std::uint64_t>(out, state.calibration_bars);
+
+    // Progress and per-ticker state
+    write_value(out, state.last_timestamp);
+    write_value<std::uint64_t>(out, state.hours_processed);
+    write_vector(out, state.portfolio);
+    write_vector(out, state.volatility);
+    write_vector(out, state.volatility_sum);
+    std::vector<std::uint64_t> volatility_count(state.volatility_count.begin(), state.volatility_count.end());
+    write_vector(out, volatility_count);
+    write_vector(out, state.last_price);
+    for (const auto& prices : state.warmup_prices) {
+        write_vector(out, prices);
+    }
+    for (const auto& sketch : state.volatility_sketches) {
+        write_sketch(out, sketch);
+    }
+    write_sketch(out, state.universe_sketch);
+
+    // Portfolio manager
+    const Portfolio_Manager_State& manager = state.manager;
+    write_value(out, manager.lambda);
+    write_vector(out, manager.expected_returns);
+    write_value<std::uint64_t>(out, manager.covariance.n);
+    write_value(out, manager.covariance.lambda);
+    write_value(out, manager.covariance.decay_power);
+    write_value<std::uint64_t>(out, manager.covariance.updates);
+    write_vector(out, manager.covariance.tiles);
+    write_string(out, manager.optimizer.mode);
+    write_value(out, manager.optimizer.risk_aversion);
+    write_value(out, manager.optimizer.max_weight);
+    write_value<std::uint64_t>(out, manager.optimizer.max_iterations);
+    write_value(out, manager.optimizer.tolerance);
+    write_vector(out, manager.optimizer.weights);
+    write_vector(out, manager.optimizer.eigenvector);
+
+    // Execution simulator
+    const Execution_Simulator& execution = state.execution;
+    write_string(out, execution.mode);
+    write_value(out, execution.fee_rate);
+    write_value(out, execution.half_spread);
+    write_value(out, execution.impact_coefficient);
+    write_value(out, execution.tick_size);
+    write_value<std::uint64_t>(out, execution.book_levels);
+    write_value(out, execution.book_depth);
+    write_vector(out, execution.price);
+    write_vector(out, execution.traded_value);
+    write_vector(out, execution.volatility);
+    write_value(out, execution.cash);
+    write_value(out, execution.fees_paid);
+    write_value(out, execution.slippage_paid);
+    write_value(out, execution.turnover);
+    write_value<std::uint64_t>(out, execution.orders);
+
+    // Performance metrics
+    const Performance_Metrics& metrics = state.metrics;
+    write_value(out, metrics.periods_per_year);
+    write_value<std::uint64_t>(out, metrics.returns.n);
+    write_value(out, metrics.returns.mean);
+    write_value(out, metrics.returns.m2);
+    write_value(out, metrics.downside_sum_squares);
+    write_value(out, metrics.log_growth);
+    write_value(out, metrics.last_value);
+    write_value(out, metrics.peak_value);
+    write_value(out, metrics.max_drawdown);
+    write_value(out, metrics.turnover);
+    write_value(out, metrics.traded);
+    write_vector(out, metrics.ticker_profit);
+    write_vector(out, metrics.ticker_contribution);
+
+    if (!out) {
+        std::cerr << "Failed to write checkpoint file: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Loads the state of a simulation from a checkpoint file.
+ *
+ * The state is only replaced if the whole checkpoint could be read and it was saved for
+ * the same tickers, in the same order, as the given symbol table.
+ *
+ * @param filename The checkpoint file.
+ * @param state Receives the simulation state.
+ * @param symbols The symbol table of the tickers about to be simulated.
+ * @return Whether the checkpoint was loaded (false, silently, if the file does not exist).
+ */
+bool load_checkpoint(const std::string& filename, Simulation_State& state, const Symbol_Table& symbols) {
+    using namespace Checkpoint;
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+
+    std::uint32_t file_magic = 0;
+    std::uint32_t file_version = 0;
+    if (!read_value(in, file_magic) || file_magic != magic) {
+        std::cerr << "Not a checkpoint file: " << filename << std::endl;
+        return false;
+    }
+    if (!read_value(in, file_version) || file_version != version) {
+        std::cerr << "Unsupported checkpoint version " << file_version << " in " << filename << std::endl;
+        return false;
+    }
+    std::uint32_t value_size = 0;
+    if (!read_value(in, value_size) || value_size != sizeof(Series_Value)) {
+        std::cerr << "Checkpoint " << filename << " was saved with " << value_size * 8 << "-bit series, this build uses "
+                  << sizeof(Series_Value) * 8 << "-bit series" << std::endl;
+        return false;
+    }
+
+    std::uint64_t n_tickers = 0;
+    if (!read_value(in, n_tickers) || n_tickers != symbols.size()) {
+        std::cerr << "Checkpoint " << filename << " was saved for different tickers" << std::endl;
+        return false;
+    }
+    for (const auto& name : symbols.names) {
+        std::string saved_name;
+        if (!read_string(in, saved_name) || saved_name != name) {
+            std::cerr << "Checkpoint " << filename << " was saved for different tickers" << std::endl;
+            return false;
+        }
+    }
+
+    Simulation_State loaded;
+    std::string allocation_mode;
+    std::uint64_t warmup_bars = 0;
+    std::uint64_t calibration_bars = 0;
+    std::uint64_t hours_processed = 0;
+    std::vector<std::uint64_t> volatility_count;
+    bool ok = read_string(in, loaded.strategy) &&
+              read_string(in, allocation_mode) &&
+              read_value(in, loaded.lambda) &&
+              read_value(in, warmup_bars) &&
+              read_value(in, loaded.initial_investment) &&
+              read_string(in, loaded.threshold_mode) &&
+              read_value(in, loaded.threshold_quantiles) &&
+              read_value(in, calibration_bars) &&
+              read_value(in, loaded.last_timestamp) &&
+              read_value(in, hours_processed) &&
+              read_vector(in, loaded.portfolio) &&
+              read_vector(in, loaded.volatility) &&
+              read_vector(in, loaded.volatility_sum) &&
+              read_vector(in, volatility_count) &&
+              read_vector(in, loaded.last_price);
+    loaded.warmup_bars = warmup_bars;
+    loaded.calibration_bars = calibration_bars;
+    loaded.hours_processed = hours_processed;
+    loaded.volatility_count.assign(volatility_count.begin(), volatility_count.end());
+    loaded.warmup_prices.resize(n_tickers);
+    for (auto& prices : loaded.warmup_prices) {
+        ok = ok && read_vector(in, prices);
+    }
+    loaded.volatility_sketches.resize(n_tickers);
+    for (auto& sketch : loaded.volatility_sketches) {
+        ok = ok && read_sketch(in, sketch);
+    }
+    ok = ok && read_sketch(in, loaded.universe_sketch);
+
+    Portfolio_Manager_State& manager = loaded.manager;
+    std::uint64_t covariance_size = 0;
+    double covariance_lambda = 0.0;
+    std::uint64_t updates = 0;
+    std::uint64_t max_iterations = 0;
+    ok = ok && read_value(in, manager.lambda) &&
+         read_vector(in, manager.expected_returns) &&
+         read_value(in, covariance_size) &&
+         read_value(in, covariance_lambda);
+    if (ok) {
+        manager.allocation_mode = allocation_mode;
+        manager.covariance = Ewma_Covariance(covariance_size, covariance_lambda);
+        manager.hour_returns.assign(n_tickers, 0.0);
+    }
+    size_t expected_tiles = manager.covariance.tiles.size();
+    ok = ok && read_value(in, manager.covariance.decay_power) &&
+         read_value(in, updates) &&
+         read_vector(in, manager.covariance.tiles) &&
+         manager.covariance.tiles.size() == expected_tiles &&
+         read_string(in, manager.optimizer.mode) &&
+         read_value(in, manager.optimizer.risk_aversion) &&
+         read_value(in, manager.optimizer.max_weight) &&
+         read_value(in, max_iterations) &&
+         read_value(in, manager.optimizer.tolerance) &&
+         read_vector(in, manager.optimizer.weights) &&
+         read_vector(in, manager.optimizer.eigenvector);
+    manager.covariance.updates = updates;
+    manager.optimizer.max_iterations = max_iterations;
+
+    Execution_Simulator& execution = loaded.execution;
+    std::uint64_t book_levels = 0;
+    std::uint64_t orders = 0;
+    ok = ok && read_string(in, execution.mode) &&
+         read_value(in, execution.fee_rate) &&
+         read_value(in, execution.half_spread) &&
+         read_value(in, execution.impact_coefficient) &&
+         read_value(in, execution.tick_size) &&
+         read_value(in, book_levels) &&
+         read_value(in, execution.book_depth) &&
+         read_vector(in, execution.price) &&
+         read_vector(in, execution.traded_value) &&
+         read_vector(in, execution.volatility) &&
+         read_value(in, execution.cash) &&
+         read_value(in, execution.fees_paid) &&
+         read_value(in, execution.slippage_paid) &&
+         read_value(in, execution.turnover) &&
+         read_value(in, orders);
+    execution.book_levels = book_levels;
+    execution.orders = orders;
+
+    Performance_Metrics& metrics = loaded.metrics;
+    std::uint64_t return_periods = 0;
+    ok = ok && read_value(in, metrics.periods_per_year) &&
+         read_value(in, return_periods) &&
+         read_value(in, metrics.returns.mean) &&
+         read_value(in, metrics.returns.m2) &&
+         read_value(in, metrics.downside_sum_squares) &&
+         read_value(in, metrics.log_growth) &&
+         read_value(in, metrics.last_value) &&
+         read_value(in, metrics.peak_value) &&
+         read_value(in, metrics.max_drawdown) &&
+         read_value(in, metrics.turnover) &&
+         read_value(in, metrics.traded) &&
+         read_vector(in, metrics.ticker_profit) &&
+         read_vector(in, metrics.ticker_contribution);
+    metrics.returns.n = return_periods;
+
+    // Every per-ticker array must cover the whole universe
+    ok = ok && loaded.portfolio.size() == n_tickers &&
+         loaded.volatility.size() == n_tickers &&
+         loaded.volatility_sum.size() == n_tickers &&
+         loaded.volatility_count.size() == n_tickers &&
+         loaded.last_price.size() == n_tickers &&
+         manager.expected_returns.size() == n_tickers &&
+         execution.price.size() == n_tickers &&
+         execution.traded_value.size() == n_tickers &&
+         execution.volatility.size() == n_tickers &&
+         metrics.ticker_profit.size() == n_tickers &&
+         metrics.ticker_contribution.size() == n_tickers;
+    if (!ok) {
+        std::cerr << "Corrupt or truncated checkpoint file: " << filename << std::endl;
+        return false;
+    }
+
+    state = std::move(loaded);
+    return true;
+}
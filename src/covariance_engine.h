@@ -0,0 +1,267 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * @struct Ewma_Covariance
+ * @brief Keeps an EWMA covariance matrix of the returns of every ticker.
+ *
+ * Each new bar updates the matrix with the rank-1 formula
+ * \f$\Sigma_t = \lambda\Sigma_{t-1} + (1 - \lambda) r_t r_t^T\f$,
+ * the multivariate version of the EWMA used by update_volatility.
+ *
+ * Only the upper triangle is stored. It is split into square tiles of
+ * block_size x block_size values, each stored contiguously, so that every
+ * kernel streams through memory once with unit-stride inner loops the
+ * compiler can vectorize (the dot products are marked with OpenMP SIMD
+ * reductions, enabled by -fopenmp-simd). Tickers are indexed by Ticker_Id.
+ */
+struct Ewma_Covariance {
+    static constexpr size_t block_size = 64;  // Tile edge; one tile is 32 KiB of doubles
+
+    /**
+     * @brief Creates an empty covariance matrix.
+     *
+     * @param n_assets The number of tickers tracked by the matrix.
+     * @param lambda The decay factor of the EWMA (0.94 matches true_volatility).
+     */
+    explicit Ewma_Covariance(size_t n_assets = 0, double lambda = 0.94)
+        : n(n_assets),
+          n_blocks((n_assets + block_size - 1) / block_size),
+          lambda(lambda),
+          tiles(n_blocks * (n_blocks + 1) / 2 * block_size * block_size, 0.0),
+          padded_returns(n_blocks * block_size, 0.0) {}
+
+    /**
+     * @brief Applies the rank-1 EWMA update for one bar.
+     *
+     * @param returns The return of each ticker during the bar. Tickers without a
+     *                bar should be given a return of 0.
+     */
+    void update(const std::vector<double>& returns) {
+        if (returns.size() != n) {
+            throw std::invalid_argument("Ewma_Covariance::update: expected one return per asset");
+        }
+        std::copy(returns.begin(), returns.end(), padded_returns.begin());
+
+        const double weight = 1.0 - lambda;
+        const double decay = lambda;
+        double* tile = tiles.data();
+        for (size_t bi = 0; bi < n_blocks; ++bi) {
+            const double* x = padded_returns.data() + bi * block_size;
+            for (size_t bj = bi; bj < n_blocks; ++bj) {
+                const double* y = padded_returns.data() + bj * block_size;
+                for (size_t r = 0; r < block_size; ++r) {
+                    const double scaled_x = weight * x[r];
+                    double* row = tile + r * block_size;
+                    for (size_t c = 0; c < block_size; ++c) {
+                        row[c] = decay * row[c] + scaled_x * y[c];
+                    }
+                }
+                tile += block_size * block_size;
+            }
+        }
+
+        decay_power *= lambda;
+        ++updates;
+    }
+
+    /**
+     * @brief Returns the covariance of the returns of two tickers.
+     *
+     * The estimate is bias corrected by \f$1/(1 - \lambda^t)\f$ so that it is not
+     * shrunk towards zero while only a few bars have been seen.
+     */
+    double covariance(size_t i, size_t j) const {
+        if (i > j) {
+            std::swap(i, j);
+        }
+        return raw(i, j) * bias_correction();
+    }
+
+    /**
+     * @brief Returns the correlation of the returns of two tickers (0 if either has no variance).
+     */
+    double correlation(size_t i, size_t j) const {
+        double denominator = std::sqrt(raw(i, i) * raw(j, j));
+        if (denominator <= 0.0) {
+            return 0.0;
+        }
+        return raw(std::min(i, j), std::max(i, j)) / denominator;
+    }
+
+    /**
+     * @brief Returns the EWMA volatility of one ticker (square root of its variance).
+     */
+    double volatility(size_t i) const {
+        return std::sqrt(covariance(i, i));
+    }
+
+    /**
+     * @brief Copies one full row of the covariance matrix.
+     *
+     * @param i The ticker whose covariances are copied.
+     * @param out Receives the covariance of ticker i with every ticker; resized to the number of tickers.
+     */
+    void row(size_t i, std::vector<double>& out) const {
+        out.resize(n);
+        const size_t bi = i / block_size;
+        const size_t r = i % block_size;
+        const double correction = bias_correction();
+
+        // Left of the diagonal block the row is column r of the tiles above it
+        for (size_t bj = 0; bj < bi; ++bj) {
+            const double* tile = tiles.data() + tile_offset(bj, bi);
+            for (size_t c = 0; c < block_size; ++c) {
+                out[bj * block_size + c] = tile[c * block_size + r] * correction;
+            }
+        }
+        // Diagonal block: mirror the upper triangle
+        const double* diagonal = tiles.data() + tile_offset(bi, bi);
+        for (size_t c = 0; c < block_size && bi * block_size + c < n; ++c) {
+            double value = c < r ? diagonal[c * block_size + r] : diagonal[r * block_size + c];
+            out[bi * block_size + c] = value * correction;
+        }
+        // Right of the diagonal block the row is stored contiguously
+        for (size_t bj = bi + 1; bj < n_blocks; ++bj) {
+            const double* tile_row = tiles.data() + tile_offset(bi, bj) + r * block_size;
+            size_t count = std::min(block_size, n - bj * block_size);
+            for (size_t c = 0; c < count; ++c) {
+                out[bj * block_size + c] = tile_row[c] * correction;
+            }
+        }
+    }
+
+    /**
+     * @brief Computes the covariance matrix times a vector of weights, without allocating.
+     *
+     * @param weights The weight of each ticker.
+     * @param out Receives \f$\Sigma w\f$; must hold one value per ticker.
+     */
+    void multiply(std::span<const double> weights, std::span<double> out) const {
+        if (weights.size() != n || out.size() != n) {
+            throw std::invalid_argument("Ewma_Covariance::multiply: expected one weight and one output per asset");
+        }
+        std::fill(out.begin(), out.end(), 0.0);
+
+        // The last block may be partial, so every loop stops at the number of tickers
+        const double* tile = tiles.data();
+        for (size_t bi = 0; bi < n_blocks; ++bi) {
+            const double* w_i = weights.data() + bi * block_size;
+            double* out_i = out.data() + bi * block_size;
+            const size_t rows = std::min(block_size, n - bi * block_size);
+            for (size_t bj = bi; bj < n_blocks; ++bj) {
+                const double* w_j = weights.data() + bj * block_size;
+                double* out_j = out.data() + bj * block_size;
+                const size_t columns = std::min(block_size, n - bj * block_size);
+                if (bi == bj) {
+                    // Diagonal tile: only its upper triangle is maintained
+                    for (size_t r = 0; r < rows; ++r) {
+                        const double* row = tile + r * block_size;
+                        const double w_r = w_i[r];
+                        double sum = row[r] * w_r;
+#pragma omp simd reduction(+:sum)
+                        for (size_t c = r + 1; c < columns; ++c) {
+                            sum += row[c] * w_j[c];
+                            out_j[c] += row[c] * w_r;
+                        }
+                        out_i[r] += sum;
+                    }
+                } else {
+                    // Off-diagonal tile contributes to both block rows
+                    for (size_t r = 0; r < rows; ++r) {
+                        const double* row = tile + r * block_size;
+                        const double w_r = w_i[r];
+                        double sum = 0.0;
+#pragma omp simd reduction(+:sum)
+                        for (size_t c = 0; c < columns; ++c) {
+                            sum += row[c] * w_j[c];
+                            out_j[c] += row[c] * w_r;
+                        }
+                        out_i[r] += sum;
+                    }
+                }
+                tile += block_size * block_size;
+            }
+        }
+
+        const double correction = bias_correction();
+        for (double& value : out) {
+            value *= correction;
+        }
+    }
+
+    /**
+     * @brief Computes the variance of a portfolio, \f$w^T \Sigma w\f$.
+     *
+     * @param weights The weight (or invested amount) of each ticker.
+     * @return The portfolio variance per bar.
+     */
+    double portfolio_variance(const std::vector<double>& weights) const {
+        std::vector<double> sigma_w(n);
+        multiply(weights, sigma_w);
+        double variance = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            variance += weights[i] * sigma_w[i];
+        }
+        return variance;
+    }
+
+    /**
+     * @brief Computes the marginal risk contribution of each ticker.
+     *
+     * The marginal contribution is \f$\partial\sigma_p / \partial w_i = (\Sigma w)_i / \sigma_p\f$.
+     * Multiplied by the weights, the contributions add up to the portfolio volatility.
+     *
+     * @param weights The weight (or invested amount) of each ticker.
+     * @return The marginal risk contribution of each ticker (all 0 for a riskless portfolio).
+     */
+    std::vector<double> marginal_risk_contributions(const std::vector<double>& weights) const {
+        std::vector<double> sigma_w(n);
+        multiply(weights, sigma_w);
+        double variance = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            variance += weights[i] * sigma_w[i];
+        }
+        double portfolio_volatility = std::sqrt(std::max(variance, 0.0));
+        for (double& value : sigma_w) {
+            value = portfolio_volatility > 0.0 ? value / portfolio_volatility : 0.0;
+        }
+        return sigma_w;
+    }
+
+    /**
+     * @brief Number of tickers tracked by the matrix.
+     */
+    size_t size() const {
+        return n;
+    }
+
+    size_t n;                            // Number of tickers
+    size_t n_blocks;                     // Number of tiles along each edge
+    double lambda;                       // EWMA decay factor
+    std::vector<double> tiles;           // Upper-triangle tiles, row-major by block row
+    std::vector<double> padded_returns;  // Scratch buffer padded to whole tiles
+    double decay_power = 1.0;            // lambda^updates, used for bias correction
+    size_t updates = 0;                  // Number of bars applied
+
+private:
+    // Offset of tile (bi, bj) in the packed tile array (requires bi <= bj)
+    size_t tile_offset(size_t bi, size_t bj) const {
+        size_t tile_index = bi * n_blocks - bi * (bi - 1) / 2 + (bj - bi);
+        return tile_index * block_size * block_size;
+    }
+
+    // Uncorrected upper-triangle entry (requires i <= j)
+    double raw(size_t i, size_t j) const {
+        return tiles[tile_offset(i / block_size, j / block_size) + (i % block_size) * block_size + (j % block_size)];
+    }
+
+    double bias_correction() const {
+        return updates == 0 ? 0.0 : 1.0 / (1.0 - decay_power);
+    }
+};
@@ -0,0 +1,310 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <string>
+#include <vector>
+#include "symbol_table.h"
+
+/**
+ * @brief Reduces a series to a number of points with Largest-Triangle-Three-Buckets.
+ *
+ * Keeps the first and last points and, for every bucket in between, the point that forms
+ * the largest triangle with the previously kept point and the average of the next bucket.
+ * This preserves the visual shape of the series in a single O(n) pass.
+ *
+ * @param x The x values (e.g., hours).
+ * @param y The y values.
+ * @param threshold The number of points to keep.
+ * @param out_x Receives the kept x values.
+ * @param out_y Receives the kept y values.
+ */
+void lttb_decimate(const std::vector<double>& x, const std::vector<double>& y, size_t threshold,
+                   std::vector<double>& out_x, std::vector<double>& out_y) {
+    out_x.clear();
+    out_y.clear();
+    const size_t n = std::min(x.size(), y.size());
+    if (threshold >= n || threshold < 3) {
+        out_x.assign(x.begin(), x.begin() + n);
+        out_y.assign(y.begin(), y.begin() + n);
+        return;
+    }
+    out_x.reserve(threshold);
+    out_y.reserve(threshold);
+
+    const double bucket_size = static_cast<double>(n - 2) / (threshold - 2);
+    size_t kept = 0;
+    out_x.push_back(x[0]);
+    out_y.push_back(y[0]);
+
+    for (size_t bucket = 0; bucket < threshold - 2; ++bucket) {
+        // Average of the next bucket (the last point for the final bucket)
+        size_t next_start = static_cast<size_t>((bucket + 1) * bucket_size) + 1;
+        size_t next_end = std::min(static_cast<size_t>((bucket + 2) * bucket_size) + 1, n);
+        double average_x = 0.0;
+        double average_y = 0.0;
+        if (next_start >= next_end) {
+            next_start = n - 1;
+            next_end = n;
+        }
+        for (size_t i = next_start; i < next_end; ++i) {
+            average_x += x[i];
+            average_y += y[i];
+        }
+        average_x /= (next_end - next_start);
+        average_y /= (next_end - next_start);
+
+        // Point of this bucket forming the largest triangle
+        size_t start = static_cast<size_t>(bucket * bucket_size) + 1;
+        size_t end = std::min(static_cast<size_t>((bucket + 1) * bucket_size) + 1, n - 1);
+        double best_area = -1.0;
+        size_t best = start;
+        for (size_t i = start; i < end; ++i) {
+            double area = std::abs((x[kept] - average_x) * (y[i] - y[kept]) -
+                                   (x[kept] - x[i]) * (average_y - y[kept]));
+            if (area > best_area) {
+                best_area = area;
+                best = i;
+            }
+        }
+        out_x.push_back(x[best]);
+        out_y.push_back(y[best]);
+        kept = best;
+    }
+
+    out_x.push_back(x[n - 1]);
+    out_y.push_back(y[n - 1]);
+}
+
+/**
+ * @brief Reduces a series by keeping the minimum and maximum of each bucket.
+ *
+ * Unlike LTTB this never hides a spike, at the cost of keeping two points per bucket.
+ * The two extremes of a bucket are kept in their original order.
+ *
+ * @param x The x values (e.g., hours).
+ * @param y The y values.
+ * @param buckets The number of buckets (at most 2 * buckets points are kept).
+ * @param out_x Receives the kept x values.
+ * @param out_y Receives the kept y values.
+ */
+void min_max_decimate(const std::vector<double>& x, const std::vector<double>& y, size_t buckets,
+                      std::vector<double>& out_x, std::vector<double>& out_y) {
+    out_x.clear();
+    out_y.clear();
+    const size_t n = std::min(x.size(), y.size());
+    if (buckets == 0 || 2 * buckets >= n) {
+        out_x.assign(x.begin(), x.begin() + n);
+        out_y.assign(y.begin(), y.begin() + n);
+        return;
+    }
+    out_x.reserve(2 * buckets);
+    out_y.reserve(2 * buckets);
+
+    for (size_t bucket = 0; bucket < buckets; ++bucket) {
+        size_t start = bucket * n / buckets;
+        size_t end = (bucket + 1) * n / buckets;
+        size_t low = start;
+        size_t high = start;
+        for (size_t i = start + 1; i < end; ++i) {
+            if (y[i] < y[low]) {
+                low = i;
+            }
+            if (y[i] > y[high]) {
+                high = i;
+            }
+        }
+        size_t first = std::min(low, high);
+        size_t second = std::max(low, high);
+        out_x.push_back(x[first]);
+        out_y.push_back(y[first]);
+        if (second != first) {
+            out_x.push_back(x[second]);
+            out_y.push_back(y[second]);
+        }
+    }
+}
+
+/**
+ * @brief Decimates a series to a pixel budget with the chosen method.
+ *
+ * @param method "lttb" or "minmax".
+ */
+void decimate(const std::vector<double>& x, const std::vector<double>& y, size_t pixels, const std::string& method,
+              std::vector<double>& out_x, std::vector<double>& out_y) {
+    if (method == "minmax") {
+        min_max_decimate(x, y, pixels / 2, out_x, out_y);
+    } else {
+        lttb_decimate(x, y, pixels, out_x, out_y);
+    }
+}
+
+/**
+ * @brief Computes the drawdown of a value series.
+ *
+ * @param values The portfolio value at each point in time.
+ * @return The drawdown at each point, in percent below the running peak (0 or negative).
+ */
+std::vector<double> drawdown_series(const std::vector<double>& values) {
+    std::vector<double> drawdowns(values.size(), 0.0);
+    double peak = 0.0;
+    for (size_t i = 0; i < values.size(); ++i) {
+        peak = std::max(peak, values[i]);
+        drawdowns[i] = peak > 0.0 ? (values[i] / peak - 1.0) * 100.0 : 0.0;
+    }
+    return drawdowns;
+}
+
+/**
+ * @struct Streaming_Decimator
+ * @brief Min/max decimation of a series that arrives one point at a time, in bounded memory.
+ *
+ * Consecutive points are grouped into buckets that keep their lowest and highest point.
+ * When max_buckets buckets are full, neighbouring buckets are merged and every later bucket
+ * takes twice as many points, so at most max_buckets buckets (2 * max_buckets points) are
+ * ever kept, however long the series. The result is what min_max_decimate gives for the
+ * final bucket width.
+ */
+struct Streaming_Decimator {
+    /**
+     * @brief Creates an empty decimator.
+     *
+     * @param max_buckets The largest number of buckets kept (rounded up to an even number, at least 2).
+     */
+    explicit Streaming_Decimator(size_t max_buckets = 1024)
+        : max_buckets(std::max<size_t>(max_buckets + max_buckets % 2, 2)) {}
+
+    /**
+     * @brief Adds the next point of the series (x values must increase).
+     */
+    void add(double x, double y) {
+        if (in_bucket == 0) {
+            buckets.push_back({x, y, x, y});
+        } else {
+            Bucket& bucket = buckets.back();
+            if (y < bucket.low_y) {
+                bucket.low_x = x;
+                bucket.low_y = y;
+            }
+            if (y > bucket.high_y) {
+                bucket.high_x = x;
+                bucket.high_y = y;
+            }
+        }
+        if (++in_bucket < points_per_bucket) {
+            return;
+        }
+        in_bucket = 0;
+        if (buckets.size() == max_buckets) {
+            // Merge neighbouring buckets; ties keep the earlier point, as min_max_decimate does
+            for (size_t i = 0; i < max_buckets / 2; ++i) {
+                const Bucket& first = buckets[2 * i];
+                const Bucket& second = buckets[2 * i + 1];
+                Bucket merged = first;
+                if (second.low_y < first.low_y) {
+                    merged.low_x = second.low_x;
+                    merged.low_y = second.low_y;
+                }
+                if (second.high_y > first.high_y) {
+                    merged.high_x = second.high_x;
+                    merged.high_y = second.high_y;
+                }
+                buckets[i] = merged;
+            }
+            buckets.resize(max_buckets / 2);
+            points_per_bucket *= 2;
+        }
+    }
+
+    /**
+     * @brief Returns the kept points in x order: the extremes of every bucket.
+     *
+     * @param out_x Receives the kept x values.
+     * @param out_y Receives the kept y values.
+     */
+    void points(std::vector<double>& out_x, std::vector<double>& out_y) const {
+        out_x.clear();
+        out_y.clear();
+        for (const Bucket& bucket : buckets) {
+            bool low_first = bucket.low_x <= bucket.high_x;
+            out_x.push_back(low_first ? bucket.low_x : bucket.high_x);
+            out_y.push_back(low_first ? bucket.low_y : bucket.high_y);
+            if (bucket.low_x != bucket.high_x) {
+                out_x.push_back(low_first ? bucket.high_x : bucket.low_x);
+                out_y.push_back(low_first ? bucket.high_y : bucket.low_y);
+            }
+        }
+    }
+
+    struct Bucket {
+        double low_x;
+        double low_y;
+        double high_x;
+        double high_y;
+    };
+
+    size_t max_buckets;             // Largest number of buckets kept
+    size_t points_per_bucket = 1;   // Points that fill one bucket
+    size_t in_bucket = 0;           // Points in the last, partly filled, bucket
+    std::vector<Bucket> buckets;    // Lowest and highest point of each bucket
+};
+
+/**
+ * @struct Portfolio_History
+ * @brief The decimated series of the portfolio charts, collected while the simulation runs.
+ *
+ * Only the total value, its drawdown and a few chosen tickers are kept, each in a
+ * Streaming_Decimator, so memory does not grow with the number of steps or of tickers.
+ */
+struct Portfolio_History {
+    /**
+     * @brief Creates an empty history.
+     *
+     * @param tickers The tickers whose positions are charted.
+     * @param max_buckets The bucket budget of every series (see Streaming_Decimator).
+     */
+    explicit Portfolio_History(const std::vector<Ticker_Id>& tickers = {}, size_t max_buckets = 1024)
+        : tickers(tickers),
+          total(max_buckets),
+          drawdown(max_buckets),
+          ticker_values(tickers.size(), Streaming_Decimator(max_buckets)) {}
+
+    /**
+     * @brief Adds one step.
+     *
+     * @param x The x value of the step (e.g., hour).
+     * @param portfolio The value of each ticker's position, indexed by Ticker_Id.
+     * @param total_value The value of the whole portfolio, cash included.
+     */
+    void add(double x, const std::vector<double>& portfolio, double total_value) {
+        total.add(x, total_value);
+        peak = std::max(peak, total_value);
+        drawdown.add(x, peak > 0.0 ? (total_value / peak - 1.0) * 100.0 : 0.0);
+        for (size_t i = 0; i < tickers.size(); ++i) {
+            ticker_values[i].add(x, tickers[i] < portfolio.size() ? portfolio[tickers[i]] : 0.0);
+        }
+    }
+
+    std::vector<Ticker_Id> tickers;                 // Charted tickers
+    Streaming_Decimator total;                      // Total portfolio value
+    Streaming_Decimator drawdown;                   // Percent below the running peak (see drawdown_series)
+    std::vector<Streaming_Decimator> ticker_values; // Value of each charted ticker's position
+    double peak = 0.0;                              // Highest total value so far
+};
+
+/**
+ * @brief Returns the tickers with the largest positions, largest first (ties by Ticker_Id).
+ *
+ * @param portfolio The value of each ticker's position, indexed by Ticker_Id.
+ * @param count The number of tickers returned (fewer if there are fewer tickers).
+ */
+std::vector<Ticker_Id> largest_positions(const std::vector<double>& portfolio, size_t count) {
+    std::vector<Ticker_Id> order(portfolio.size());
+    std::iota(order.begin(), order.end(), 0);
+    count = std::min(count, order.size());
+    std::partial_sort(order.begin(), order.begin() + count, order.end(), [&portfolio](Ticker_Id a, Ticker_Id b) {
+        return portfolio[a] > portfolio[b] || (portfolio[a] == portfolio[b] && a < b);
+    });
+    order.resize(count);
+    return order;
+}
@@ -0,0 +1,391 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+#include "symbol_table.h"
+
+/**
+ * @struct Book_Execution
+ * @brief Result of a market order walking a Limit_Order_Book.
+ */
+struct Book_Execution {
+    double quantity = 0.0;  // Shares filled
+    double notional = 0.0;  // Cash paid or received for them
+};
+
+/**
+ * @struct Limit_Order_Book
+ * @brief Limit order book on a fixed price grid, stored as flat arrays of price levels.
+ *
+ * Level i sits at base_price + i * tick_size. The resting quantity of every level is kept
+ * in a preallocated array per side (no node-based maps), so adding liquidity is an index
+ * computation and a market order walks contiguous memory from the best level outwards.
+ * reset only clears the levels touched since the previous reset, so one book can be
+ * reused for millions of orders.
+ */
+struct Limit_Order_Book {
+    /**
+     * @brief Creates an empty book.
+     *
+     * @param n_levels The number of price levels of the grid (grown by reset if needed).
+     */
+    explicit Limit_Order_Book(size_t n_levels = 256)
+        : bid_quantity(n_levels, 0.0), ask_quantity(n_levels, 0.0) {}
+
+    /**
+     * @brief Empties the book and centers its price grid on a price.
+     *
+     * @param mid_price The price at the center of the grid.
+     * @param tick The price step between levels.
+     * @param min_levels The number of levels needed on each side of the center.
+     */
+    void reset(double mid_price, double tick, size_t min_levels) {
+        for (size_t i = touched_low; i < touched_high; ++i) {
+            bid_quantity[i] = 0.0;
+            ask_quantity[i] = 0.0;
+        }
+        if (bid_quantity.size() < 2 * min_levels + 1) {
+            bid_quantity.assign(2 * min_levels + 1, 0.0);
+            ask_quantity.assign(2 * min_levels + 1, 0.0);
+        }
+        tick_size = tick;
+        center = bid_quantity.size() / 2;
+        base_price = mid_price - static_cast<double>(center) * tick_size;
+        touched_low = bid_quantity.size();
+        touched_high = 0;
+        has_bid = false;
+        has_ask = false;
+    }
+
+    /**
+     * @brief Returns the price of a level.
+     */
+    double level_price(size_t level) const {
+        return base_price + static_cast<double>(level) * tick_size;
+    }
+
+    /**
+     * @brief Rests a limit order in the book.
+     *
+     * @param buy Whether it is a bid (true) or an ask (false).
+     * @param price The limit price, rounded to the nearest level (clamped to the grid).
+     * @param quantity The number of shares.
+     */
+    void add_limit(bool buy, double price, double quantity) {
+        double position = std::round((price - base_price) / tick_size);
+        size_t level = static_cast<size_t>(std::clamp(position, 0.0, static_cast<double>(bid_quantity.size() - 1)));
+        touched_low = std::min(touched_low, level);
+        touched_high = std::max(touched_high, level + 1);
+        if (buy) {
+            bid_quantity[level] += quantity;
+            if (!has_bid || level > best_bid) {
+                best_bid = level;
+                has_bid = true;
+            }
+        } else {
+            ask_quantity[level] += quantity;
+            if (!has_ask || level < best_ask) {
+                best_ask = level;
+                has_ask = true;
+            }
+        }
+    }
+
+    /**
+     * @brief Sells shares at market, walking the bids from the best price down.
+     *
+     * @param quantity The number of shares to sell.
+     * @return The shares filled and the cash received (less than requested if the bids run out).
+     */
+    Book_Execution market_sell(double quantity) {
+        Book_Execution execution;
+        while (has_bid && quantity > 0.0) {
+            double take = std::min(quantity, bid_quantity[best_bid]);
+            bid_quantity[best_bid] -= take;
+            quantity -= take;
+            execution.quantity += take;
+            execution.notional += take * level_price(best_bid);
+            if (bid_quantity[best_bid] <= 0.0) {
+                // Next non-empty level below
+                has_bid = false;
+                for (size_t level = best_bid; level-- > touched_low;) {
+                    if (bid_quantity[level] > 0.0) {
+                        best_bid = level;
+                        has_bid = true;
+                        break;
+                    }
+                }
+            }
+        }
+        return execution;
+    }
+
+    /**
+     * @brief Buys at market for an amount of cash, walking the asks from the best price up.
+     *
+     * @param cash The amount to spend.
+     * @return The shares filled and the cash spent (less than given if the asks run out).
+     */
+    Book_Execution market_buy(double cash) {
+        Book_Execution execution;
+        while (has_ask && cash > 0.0) {
+            double price = level_price(best_ask);
+            double affordable = cash / price;
+            if (affordable < ask_quantity[best_ask]) {
+                // The order ends inside this level
+                ask_quantity[best_ask] -= affordable;
+                execution.quantity += affordable;
+                execution.notional += cash;
+                break;
+            }
+            double take = ask_quantity[best_ask];
+            ask_quantity[best_ask] = 0.0;
+            cash -= take * price;
+            execution.quantity += take;
+            execution.notional += take * price;
+
+            // Next non-empty level above
+            has_ask = false;
+            for (size_t level = best_ask + 1; level < touched_high; ++level) {
+                if (ask_quantity[level] > 0.0) {
+                    best_ask = level;
+                    has_ask = true;
+                    break;
+                }
+            }
+        }
+        return execution;
+    }
+
+    double tick_size = 0.01;            // Price step between levels
+    double base_price = 0.0;            // Price of level 0
+    size_t center = 0;                  // Level of the price the grid was centered on
+    std::vector<double> bid_quantity;   // Resting bid shares per level
+    std::vector<double> ask_quantity;   // Resting ask shares per level
+    size_t best_bid = 0;                // Highest level with bids (if has_bid)
+    size_t best_ask = 0;                // Lowest level with asks (if has_ask)
+    bool has_bid = false;
+    bool has_ask = false;
+    size_t touched_low = 0;             // Levels [touched_low, touched_high) may hold quantity
+    size_t touched_high = 0;
+};
+
+/**
+ * @struct Execution_Fill
+ * @brief How one order changed a position and the cash.
+ */
+struct Execution_Fill {
+    double position_change = 0.0;  // Change of the position's value at the reference price (negative for sells)
+    double cash_change = 0.0;      // Cash received (positive) or spent (negative), after fees
+    double fees = 0.0;             // Fees paid
+    double slippage = 0.0;         // Spread and impact paid against the reference price
+};
+
+/**
+ * @struct Execution_Simulator
+ * @brief Turns the managers' buy and sell decisions into fills with transaction costs.
+ *
+ * Supported modes:
+ * - "instant": orders fill at the last price at no cost (the managers' original behavior).
+ * - "costs": a proportional fee, half the bid-ask spread, and a square-root market impact
+ *   \f$k \sigma \sqrt{N / V}\f$ of the order's notional N against the bar's traded value V.
+ * - "order_book": orders walk a Limit_Order_Book built from the bar around the last price
+ *   (spread, then book_levels levels each showing a share of the bar's volume), plus the
+ *   proportional fee. Each ticker's book is built at its first order of a step and later
+ *   orders in the same step consume what is left of it. Orders larger than the shown
+ *   liquidity fill partially; unspent cash is kept and handed back through withdraw_cash.
+ *
+ * Positions are valued at the last price, so costs show up as lost portfolio value.
+ * Per-ticker vectors are indexed by Ticker_Id.
+ */
+struct Execution_Simulator {
+    /**
+     * @brief Creates an execution simulator.
+     *
+     * @param n_tickers The number of tickers.
+     * @param mode "instant", "costs" or "order_book".
+     */
+    explicit Execution_Simulator(size_t n_tickers = 0, const std::string& mode = "instant")
+        : mode(mode),
+          price(n_tickers, 0.0),
+          traded_value(n_tickers, 0.0),
+          volatility(n_tickers, 0.0) {}
+
+    /**
+     * @brief Starts a new time step: every ticker's book is rebuilt at its next order.
+     */
+    void start_step() {
+        ++step;
+    }
+
+    /**
+     * @brief Records the latest bar of a ticker; orders are priced against it.
+     *
+     * @param stock The ticker.
+     * @param close The closing price of the bar.
+     * @param volume The number of shares traded during the bar.
+     * @param bar_volatility The ticker's volatility per bar (0 if unknown).
+     */
+    void observe(Ticker_Id stock, double close, double volume, double bar_volatility) {
+        price[stock] = close;
+        traded_value[stock] = close * volume;
+        volatility[stock] = std::isnan(bar_volatility) ? 0.0 : bar_volatility;
+    }
+
+    /**
+     * @brief Sells part of a position.
+     *
+     * @param stock The ticker.
+     * @param amount The value to sell at the last price.
+     * @return The fill; the position shrinks by -position_change and cash_change is received.
+     */
+    Execution_Fill sell(Ticker_Id stock, double amount) {
+        Execution_Fill fill;
+        if (amount <= 0.0) {
+            return fill;
+        }
+        if (mode == "costs") {
+            double slippage = amount * slippage_rate(stock, amount);
+            fill.position_change = -amount;
+            fill.slippage = slippage;
+            fill.fees = amount * fee_rate;
+            fill.cash_change = amount - slippage - fill.fees;
+        } else if (mode == "order_book" && price[stock] > 0.0) {
+            Book_Execution execution = ticker_book(stock, amount).market_sell(amount / price[stock]);
+            double filled = execution.quantity * price[stock];
+            fill.position_change = -filled;
+            fill.slippage = filled - execution.notional;
+            fill.fees = execution.notional * fee_rate;
+            fill.cash_change = execution.notional - fill.fees;
+        } else {
+            fill.position_change = -amount;
+            fill.cash_change = amount;
+        }
+        record(fill, -fill.position_change);
+        return fill;
+    }
+
+    /**
+     * @brief Buys into a position.
+     *
+     * @param stock The ticker.
+     * @param amount The cash to spend, fees included.
+     * @return The fill; the position grows by position_change and -cash_change is spent.
+     */
+    Execution_Fill buy(Ticker_Id stock, double amount) {
+        Execution_Fill fill;
+        if (amount <= 0.0) {
+            return fill;
+        }
+        if (mode == "costs") {
+            fill.fees = amount * fee_rate / (1.0 + fee_rate);
+            double notional = amount - fill.fees;
+            double rate = slippage_rate(stock, notional);
+            fill.position_change = notional / (1.0 + rate);
+            fill.slippage = notional - fill.position_change;
+            fill.cash_change = -amount;
+        } else if (mode == "order_book" && price[stock] > 0.0) {
+            Book_Execution execution = ticker_book(stock, amount).market_buy(amount / (1.0 + fee_rate));
+            fill.fees = execution.notional * fee_rate;
+            fill.position_change = execution.quantity * price[stock];
+            fill.slippage = execution.notional - fill.position_change;
+            fill.cash_change = -(execution.notional + fill.fees);
+            cash += amount + fill.cash_change; // Unspent cash when the asks run out
+        } else {
+            fill.position_change = amount;
+            fill.cash_change = -amount;
+        }
+        record(fill, fill.position_change);
+        return fill;
+    }
+
+    /**
+     * @brief Returns the cash left over by partially filled buys and resets it.
+     */
+    double withdraw_cash() {
+        double withdrawn = cash;
+        cash = 0.0;
+        return withdrawn;
+    }
+
+    // Cost model
+    std::string mode;                   // "instant", "costs" or "order_book"
+    double fee_rate = 0.0005;           // Proportional fee (5 bps)
+    double half_spread = 0.0002;        // Half the bid-ask spread, as a fraction of the price (2 bps)
+    double impact_coefficient = 0.1;    // k of the square-root impact ("costs")
+    double tick_size = 0.01;            // Price step of the order book ("order_book")
+    size_t book_levels = 20;            // Levels shown on each side of the book
+    double book_depth = 0.05;           // Share of the bar's volume shown on each side of the book
+
+    // Latest bar of each ticker
+    std::vector<double> price;          // Last price
+    std::vector<double> traded_value;   // Price times volume of the last bar
+    std::vector<double> volatility;     // Volatility per bar
+
+    // Totals over the run
+    double cash = 0.0;                  // Cash left over by partial fills, not yet withdrawn
+    double fees_paid = 0.0;
+    double slippage_paid = 0.0;
+    double turnover = 0.0;              // Value traded at the reference price
+    size_t orders = 0;
+
+    // Order books ("order_book"), built lazily once per ticker and step
+    size_t step = 0;                    // Current time step (see start_step)
+    std::vector<Limit_Order_Book> books;  // Book of each ticker
+    std::vector<size_t> book_step;      // Step each ticker's book was built in
+
+private:
+    // Spread plus square-root impact as a fraction of the notional
+    double slippage_rate(Ticker_Id stock, double notional) const {
+        double rate = half_spread;
+        if (traded_value[stock] > 0.0) {
+            rate += impact_coefficient * volatility[stock] * std::sqrt(notional / traded_value[stock]);
+        }
+        return rate;
+    }
+
+    // The ticker's book for this step, built at its first order. Without volume data the
+    // book is sized to the order, so it is rebuilt for every order.
+    Limit_Order_Book& ticker_book(Ticker_Id stock, double amount) {
+        if (books.size() < price.size()) {
+            books.resize(price.size(), Limit_Order_Book(0));
+            book_step.resize(price.size(), std::numeric_limits<size_t>::max());
+        }
+        if (book_step[stock] != step || traded_value[stock] <= 0.0) {
+            build_book(books[stock], stock, amount);
+            book_step[stock] = step;
+        }
+        return books[stock];
+    }
+
+    // Liquidity around the last price: the spread, then book_levels levels per side.
+    // Below $1 the grid uses $0.0001 steps (tick_size / 100), as US sub-dollar quotes do,
+    // and bid levels that would sit at or below zero are left out.
+    void build_book(Limit_Order_Book& book, Ticker_Id stock, double amount) {
+        double mid = price[stock];
+        double tick = mid < 1.0 ? tick_size / 100.0 : tick_size;
+        size_t spread_ticks = std::max<size_t>(1, static_cast<size_t>(std::round(mid * half_spread / tick)));
+        book.reset(mid, tick, spread_ticks + book_levels);
+
+        // Without volume data, show enough liquidity at every level to fill the order there
+        double shares_per_level = traded_value[stock] > 0.0
+            ? book_depth * (traded_value[stock] / mid) / book_levels
+            : amount / mid;
+        for (size_t k = 0; k < book_levels; ++k) {
+            double offset = static_cast<double>(spread_ticks + k) * tick;
+            if (mid - offset > 0.0) {
+                book.add_limit(true, mid - offset, shares_per_level);
+            }
+            book.add_limit(false, mid + offset, shares_per_level);
+        }
+    }
+
+    void record(const Execution_Fill& fill, double traded) {
+        fees_paid += fill.fees;
+        slippage_paid += fill.slippage;
+        turnover += traded;
+        ++orders;
+    }
+};
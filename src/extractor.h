@@ -8,7 +8,9 @@
 #include <curl/curl.h>
 #include <nlohmann/json.hpp>
 #include <ctime>
-#include <iomanip> // For std::setprecision and std::fixed
+#include <iomanip> // For std::setprecision, std::get_time and std::put_time
+#include <limits>
+#include "ohlcv.h"
 
 using json = nlohmann::json;
 
@@ -31,7 +33,8 @@ size_t write_call_back(void* contents, size_t size, size_t nmemb, std::string* u
 /**
  * @brief Converts a date string to a Unix timestamp.
  * 
- * The function converts a date in the format "YYYY-MM-DD" into a Unix timestamp.
+ * The function converts a date in the format "YYYY-MM-DD" into the Unix timestamp of its
+ * midnight UTC, the time zone add_months and Time_Index work in.
  * 
  * @param date The date string to convert.
  * @return The Unix timestamp representation of the date.
@@ -40,26 +43,45 @@ long convert_to_timestamp(const std::string& date) {
     std::tm tm = {};
     std::istringstream ss(date);
     ss >> std::get_time(&tm, "%Y-%m-%d");
-    return std::mktime(&tm);
+    return timegm(&tm);
 }
 
 /**
- * @brief Fetches stock data and stores prices in a map.
+ * @brief Converts a Unix timestamp to the "YYYY-MM-DD" date it falls on (UTC).
+ *
+ * @param timestamp The Unix timestamp to convert.
+ * @return The date string (see convert_to_timestamp).
+ */
+std::string convert_to_date(long timestamp) {
+    std::time_t time = timestamp;
+    std::tm tm = {};
+    gmtime_r(&time, &tm);
+    std::ostringstream ss;
+    ss << std::put_time(&tm, "%Y-%m-%d");
+    return ss.str();
+}
+
+/**
+ * @brief Downloads the raw Yahoo Finance chart of a ticker.
  * 
- * This function uses CURL to fetch stock data from Yahoo Finance for a specified 
- * ticker and date range, and stores the prices in a map.
+ * This function uses CURL to fetch the chart of a ticker for a date range and bar
+ * interval. It only does the network part, so downloads of several tickers can run
+ * on separate threads while other tickers are parsed (see parse_stock_bars).
+ * curl_global_init must have been called before downloading from several threads.
  * 
  * @param ticker The stock ticker symbol (e.g., "AAPL").
  * @param start_date The start date for data retrieval in "YYYY-MM-DD" format.
  * @param end_date The end date for data retrieval in "YYYY-MM-DD" format.
- * @param ticker_to_prices A reference to a map to store the fetched prices.
+ * @param interval The bar interval (e.g., "1m", "5m", "1h", "1d").
+ * @param response_data Receives the JSON response.
+ * @return Whether the download succeeded.
  */
-void get_stock_data(const std::string& ticker, const std::string& start_date, const std::string& end_date, 
-                    std::map<std::string, std::vector<double>>& ticker_to_prices) {
+bool fetch_stock_chart(const std::string& ticker, const std::string& start_date, const std::string& end_date,
+                       const std::string& interval, std::string& response_data) {
     CURL* curl = curl_easy_init();
     if (!curl) {
         std::cerr << "Failed to initialize CURL" << std::endl;
-        return;
+        return false;
     }
 
     long period1 = convert_to_timestamp(start_date);
@@ -68,46 +90,127 @@ void get_stock_data(const std::string& ticker, const std::string& start_date, co
     std::string url = "https://query1.finance.yahoo.com/v8/finance/chart/" + ticker +
                       "?period1=" + std::to_string(period1) +
                       "&period2=" + std::to_string(period2) +
-                      "&interval=1h";
+                      "&interval=" + interval;
 
     struct curl_slist* headers = NULL;
     headers = curl_slist_append(headers, "User-Agent: Mozilla/5.0");
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
 
-    std::string response_data;
     curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_call_back);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_data);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L); // Required for timeouts on worker threads
 
     CURLcode res = curl_easy_perform(curl);
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
     if (res != CURLE_OK) {
         std::cerr << "Failed to fetch data: " << curl_easy_strerror(res) << std::endl;
-        curl_easy_cleanup(curl);
-        curl_slist_free_all(headers);
-        return;
+        return false;
     }
+    return true;
+}
 
+/**
+ * @brief Parses the OHLCV bars out of a Yahoo Finance chart response.
+ * 
+ * Bars without a close are skipped; missing open, high or low values fall back to
+ * the close and missing volumes to 0.
+ * 
+ * @param ticker The stock ticker symbol, used in console messages.
+ * @param response_data The JSON response (see fetch_stock_chart).
+ * @param bars Receives the bars, appended in timestamp order.
+ * @return Whether the response could be parsed.
+ */
+bool parse_stock_bars(const std::string& ticker, const std::string& response_data, std::vector<Ohlcv_Bar>& bars) {
     try {
         json data = json::parse(response_data);
 
         if (!data["chart"]["result"][0]["timestamp"].is_null()) {
-            auto timestamps = data["chart"]["result"][0]["timestamp"];
-            auto prices = data["chart"]["result"][0]["indicators"]["quote"][0]["close"];
-
+            const auto& timestamps = data["chart"]["result"][0]["timestamp"];
+            const auto& quote = data["chart"]["result"][0]["indicators"]["quote"][0];
+            const auto& opens = quote["open"];
+            const auto& highs = quote["high"];
+            const auto& lows = quote["low"];
+            const auto& closes = quote["close"];
+            const auto& volumes = quote["volume"];
+
+            auto value_or = [](const json& values, size_t i, double fallback) {
+                return i < values.size() && !values[i].is_null() ? static_cast<double>(values[i]) : fallback;
+            };
+
+            bars.reserve(bars.size() + timestamps.size());
             for (size_t i = 0; i < timestamps.size(); i++) {
-                if (!prices[i].is_null()) {
-                    ticker_to_prices[ticker].push_back(static_cast<double>(prices[i]));
+                if (i >= closes.size() || closes[i].is_null()) {
+                    continue;
                 }
+                Ohlcv_Bar bar;
+                bar.timestamp = static_cast<long>(timestamps[i]);
+                bar.close = static_cast<double>(closes[i]);
+                bar.open = value_or(opens, i, bar.close);
+                bar.high = value_or(highs, i, bar.close);
+                bar.low = value_or(lows, i, bar.close);
+                bar.volume = value_or(volumes, i, 0.0);
+                bars.push_back(bar);
             }
 
-            std::cout << "Data for " << ticker << " has been processed and stored." << std::endl;
+            // One write per message, so lines from parallel tasks do not interleave
+            std::cout << ("Data for " + ticker + " has been processed and stored.\n") << std::flush;
         }
     } catch (const json::exception& e) {
         std::cerr << "JSON error: " << e.what() << std::endl;
+        return false;
     }
+    return true;
+}
 
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
+/**
+ * @brief Fetches OHLCV bars and stores them in a map.
+ * 
+ * This function uses CURL to fetch stock data from Yahoo Finance for a specified 
+ * ticker, date range and bar interval (see fetch_stock_chart), and stores the open,
+ * high, low, close and volume of every bar in a map (see parse_stock_bars).
+ * 
+ * @param ticker The stock ticker symbol (e.g., "AAPL").
+ * @param start_date The start date for data retrieval in "YYYY-MM-DD" format.
+ * @param end_date The end date for data retrieval in "YYYY-MM-DD" format.
+ * @param interval The bar interval (e.g., "1m", "5m", "1h", "1d").
+ * @param ticker_to_bars A reference to a map to store the fetched bars.
+ */
+void get_stock_bars(const std::string& ticker, const std::string& start_date, const std::string& end_date,
+                    const std::string& interval, std::map<std::string, std::vector<Ohlcv_Bar>>& ticker_to_bars) {
+    std::string response_data;
+    if (fetch_stock_chart(ticker, start_date, end_date, interval, response_data)) {
+        std::vector<Ohlcv_Bar> bars;
+        parse_stock_bars(ticker, response_data, bars);
+        if (!bars.empty()) {
+            std::vector<Ohlcv_Bar>& stored = ticker_to_bars[ticker];
+            stored.insert(stored.end(), bars.begin(), bars.end());
+        }
+    }
+}
+
+/**
+ * @brief Fetches stock data and stores prices in a map.
+ * 
+ * This function fetches the bars of a ticker (see get_stock_bars) and only keeps
+ * their closing prices.
+ * 
+ * @param ticker The stock ticker symbol (e.g., "AAPL").
+ * @param start_date The start date for data retrieval in "YYYY-MM-DD" format.
+ * @param end_date The end date for data retrieval in "YYYY-MM-DD" format.
+ * @param ticker_to_prices A reference to a map to store the fetched prices.
+ * @param interval The bar interval (hourly by default).
+ */
+void get_stock_data(const std::string& ticker, const std::string& start_date, const std::string& end_date, 
+                    std::map<std::string, std::vector<double>>& ticker_to_prices, const std::string& interval = "1h") {
+    std::map<std::string, std::vector<Ohlcv_Bar>> ticker_to_bars;
+    get_stock_bars(ticker, start_date, end_date, interval, ticker_to_bars);
+    if (ticker_to_bars.count(ticker)) {
+        std::vector<double> closes = closing_prices(ticker_to_bars[ticker]);
+        std::vector<double>& prices = ticker_to_prices[ticker];
+        prices.insert(prices.end(), closes.begin(), closes.end());
+    }
 }
 
 /**
@@ -127,7 +230,8 @@ void save_to_csv(const std::string& filename, const std::map<std::string, std::v
     }
 
     file << "ticker,price\n";
-    file << std::fixed << std::setprecision(20); 
+    // Shortest precision that still reads back as the same double
+    file << std::setprecision(std::numeric_limits<double>::max_digits10);
     for (const auto& [ticker, prices] : ticker_to_prices) {
         for (const auto& price : prices) {
             file << ticker << "," << price << "\n";
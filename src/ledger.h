@@ -0,0 +1,447 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility> // For std::pair
+#include <vector>
+#include "symbol_table.h"
+
+/**
+ * @brief Kind of event a Ledger_Record stands for.
+ */
+enum class Ledger_Type : std::uint8_t {
+    Open = 0,       // Position held when the ledger was started (again once the ticker's first price is known)
+    Sell = 1,       // Stock manager sold part of a position; amount is the value sold
+    Allocate = 2    // Portfolio manager allocated funds to the stock; amount is the funds
+};
+
+/**
+ * @struct Ledger_Record
+ * @brief One fixed-size entry of a trade ledger (40 bytes).
+ *
+ * Records are only written when money moves, so a ledger grows with the trades, not with
+ * the hours times the tickers. Every record holds the position of its ticker right after
+ * the event and the price it is valued at, so a position's value at any later time is its
+ * last record's position scaled by the price move since (see replay_portfolio).
+ */
+struct Ledger_Record {
+    std::int64_t timestamp;         // Timestamp of the bars of the step
+    double amount;                  // Value traded
+    double position;                // Value of the ticker's position after the event
+    double price;                   // Price the position is valued at (NaN before the ticker's first bar)
+    Ticker_Id stock;                // Interned ticker
+    Ledger_Type type;               // Kind of event
+    std::uint8_t reserved[3] = {};  // Padding, always zero
+};
+static_assert(sizeof(Ledger_Record) == 40, "Ledger_Record must stay 40 bytes");
+
+/**
+ * @brief Layout of ledger files.
+ *
+ * A header (magic number, version, record size and the ticker symbols, padded to a whole
+ * number of records) is followed by the records in the order they were appended, so their
+ * timestamps never decrease. Values are stored in the machine's native byte order.
+ */
+namespace Ledger_File {
+    constexpr std::uint32_t magic = 0x474C4D53;  // "SMLG"
+    constexpr std::uint32_t version = 2;
+
+    /**
+     * @brief Writes the header of a new ledger.
+     */
+    void write_header(std::ostream& out, const Symbol_Table& symbols) {
+        const std::uint32_t fields[4] = {magic, version, sizeof(Ledger_Record), 0};
+        out.write(reinterpret_cast<const char*>(fields), sizeof(fields));
+        std::uint64_t n_symbols = symbols.size();
+        out.write(reinterpret_cast<const char*>(&n_symbols), sizeof(n_symbols));
+        std::uint64_t written = sizeof(fields) + sizeof(n_symbols);
+        for (const auto& name : symbols.names) {
+            std::uint64_t length = name.size();
+            out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+            out.write(name.data(), name.size());
+            written += sizeof(length) + name.size();
+        }
+        const char padding[sizeof(Ledger_Record)] = {};
+        out.write(padding, (sizeof(Ledger_Record) - written % sizeof(Ledger_Record)) % sizeof(Ledger_Record));
+    }
+
+    /**
+     * @brief Reads the header of a ledger.
+     *
+     * @param in The ledger file, at its start.
+     * @param symbols Receives the ticker symbols.
+     * @param header_bytes Receives the size of the header, where the records start.
+     * @return Whether a valid header was read.
+     */
+    bool read_header(std::istream& in, Symbol_Table& symbols, std::uint64_t& header_bytes) {
+        std::uint32_t fields[4] = {};
+        std::uint64_t n_symbols = 0;
+        if (!in.read(reinterpret_cast<char*>(fields), sizeof(fields)) ||
+            fields[0] != magic || fields[1] != version || fields[2] != sizeof(Ledger_Record) ||
+            !in.read(reinterpret_cast<char*>(&n_symbols), sizeof(n_symbols))) {
+            return false;
+        }
+        std::uint64_t read = sizeof(fields) + sizeof(n_symbols);
+        symbols = Symbol_Table();
+        for (std::uint64_t i = 0; i < n_symbols; ++i) {
+            std::uint64_t length = 0;
+            if (!in.read(reinterpret_cast<char*>(&length), sizeof(length)) || length > (1u << 16)) {
+                return false;
+            }
+            std::string name(length, '\0');
+            if (!in.read(name.data(), length)) {
+                return false;
+            }
+            symbols.intern(name);
+            read += sizeof(length) + length;
+        }
+        header_bytes = read + (sizeof(Ledger_Record) - read % sizeof(Ledger_Record)) % sizeof(Ledger_Record);
+        return symbols.size() == n_symbols;
+    }
+}
+
+/**
+ * @struct Trade_Ledger
+ * @brief Append-only binary ledger of every sell and allocation of a simulation.
+ *
+ * The managers append records while they run (see stock_manager_hour and portfolio_manager_hour);
+ * records are buffered and written in blocks. Price moves are not recorded: each record carries
+ * the price its position is valued at, and the closes handed to begin_step give that price.
+ * Reopening an existing ledger appends to it, so a resumed simulation continues the same ledger.
+ * Read it back with Ledger_Reader.
+ */
+struct Trade_Ledger {
+    /**
+     * @brief Creates a ledger, or opens an existing one to append to it.
+     *
+     * A partly written record at the end of an existing ledger (e.g., after a crash) is dropped.
+     *
+     * @param filename The ledger file.
+     * @param symbols The symbol table of the simulated tickers.
+     * @throws std::runtime_error If the file cannot be written, or is a ledger of other tickers.
+     */
+    Trade_Ledger(const std::string& filename, const Symbol_Table& symbols)
+        : filename(filename), priced(symbols.size(), 0), unpriced(symbols.size()) {
+        std::error_code error;
+        std::uint64_t file_size = std::filesystem::file_size(filename, error);
+        bool exists = !error && file_size > 0;
+        error.clear();
+        if (exists) {
+            std::ifstream in(filename, std::ios::binary);
+            Symbol_Table saved_symbols;
+            std::uint64_t header_bytes = 0;
+            if (!Ledger_File::read_header(in, saved_symbols, header_bytes) || saved_symbols.names != symbols.names) {
+                throw std::runtime_error("Trade_Ledger: " + filename + " is not a ledger of these tickers");
+            }
+            records = file_size > header_bytes ? (file_size - header_bytes) / sizeof(Ledger_Record) : 0;
+
+            // Tickers that already have a price in the ledger
+            in.seekg(static_cast<std::streamoff>(header_bytes));
+            Ledger_Record record;
+            for (std::uint64_t i = 0; i < records && in.read(reinterpret_cast<char*>(&record), sizeof(record)); ++i) {
+                if (record.stock < priced.size() && !priced[record.stock] && !std::isnan(record.price)) {
+                    priced[record.stock] = 1;
+                    --unpriced;
+                }
+            }
+            in.close();
+            std::filesystem::resize_file(filename, header_bytes + records * sizeof(Ledger_Record), error);
+            out.open(filename, std::ios::binary | std::ios::app);
+        } else {
+            out.open(filename, std::ios::binary | std::ios::trunc);
+            Ledger_File::write_header(out, symbols);
+        }
+        if (error || !out) {
+            throw std::runtime_error("Trade_Ledger: cannot write " + filename);
+        }
+        buffer.reserve(buffer_records);
+    }
+
+    ~Trade_Ledger() {
+        flush();
+    }
+
+    Trade_Ledger(const Trade_Ledger&) = delete;
+    Trade_Ledger& operator=(const Trade_Ledger&) = delete;
+
+    /**
+     * @brief Starts a time step, after its bars were processed: later records get its timestamp and prices.
+     *
+     * The first step of a new ledger records the positions held at that point (Open records).
+     * A ticker without a price then gets a second Open record at its first bar.
+     * The closes and changes are copied, in double, for the records of the step.
+     *
+     * @tparam T The value type of the price series.
+     * @param step_timestamp The timestamp of the step's bars.
+     * @param portfolio The value of each ticker's position, indexed by Ticker_Id.
+     * @param closes The last close of each ticker (NaN before its first bar).
+     * @param percentage_changes Each ticker's price change in this step (NaN without a new bar).
+     */
+    template <typename T>
+    void begin_step(long step_timestamp, const std::vector<double>& portfolio,
+                    const std::vector<T>& closes, const std::vector<T>& percentage_changes) {
+        timestamp = step_timestamp;
+        step_closes.assign(closes.begin(), closes.end());
+        step_changes.assign(percentage_changes.begin(), percentage_changes.end());
+        if (records == 0) {
+            for (Ticker_Id stock = 0; stock < portfolio.size(); ++stock) {
+                append(Ledger_Type::Open, stock, portfolio[stock], portfolio[stock]);
+            }
+        }
+        for (Ticker_Id stock = 0; unpriced > 0 && stock < portfolio.size() && stock < priced.size(); ++stock) {
+            if (!priced[stock] && !std::isnan(step_price(stock, Ledger_Type::Open))) {
+                append(Ledger_Type::Open, stock, portfolio[stock], portfolio[stock]);
+            }
+        }
+    }
+
+    /**
+     * @brief Appends a record with the timestamp and prices of the current step.
+     *
+     * Positions are valued at the previous close until the portfolio manager applies the
+     * step's price changes, so sells (and Open records) get the price before the step's move
+     * and allocations the step's close.
+     *
+     * @param type The kind of event.
+     * @param stock The ticker.
+     * @param amount The value traded.
+     * @param position The value of the ticker's position after the event.
+     */
+    void append(Ledger_Type type, Ticker_Id stock, double amount, double position) {
+        double price = step_price(stock, type);
+        Ledger_Record record{timestamp, amount, position, price, stock, type};
+        buffer.push_back(record);
+        ++records;
+        if (stock < priced.size() && !priced[stock] && !std::isnan(price)) {
+            priced[stock] = 1;
+            --unpriced;
+        }
+        if (buffer.size() >= buffer_records) {
+            flush();
+        }
+    }
+
+    /**
+     * @brief Writes the buffered records to the file.
+     *
+     * @return Whether every record so far was written.
+     */
+    bool flush() {
+        if (!buffer.empty()) {
+            out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(Ledger_Record));
+            buffer.clear();
+        }
+        out.flush();
+        if (!out) {
+            std::cerr << "Failed to write ledger file: " << filename << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Number of records in the ledger, including the buffered ones.
+     */
+    std::uint64_t size() const {
+        return records;
+    }
+
+    std::string filename;                   // Ledger file
+    long timestamp = 0;                     // Timestamp of the current step
+    size_t buffer_records = 4096;           // Records buffered before they are written
+
+private:
+    // Price a position is valued at when an event of the given type happens in the current step
+    double step_price(Ticker_Id stock, Ledger_Type type) const {
+        if (stock >= step_closes.size()) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        double close = step_closes[stock];
+        double percentage_change = stock < step_changes.size() ? step_changes[stock] : std::nan("");
+        if (type == Ledger_Type::Allocate || std::isnan(percentage_change) || percentage_change == -100.0) {
+            return close;
+        }
+        return close / (1.0 + percentage_change / 100.0);
+    }
+
+    std::ofstream out;
+    std::vector<Ledger_Record> buffer;
+    std::uint64_t records = 0;
+    std::vector<double> step_closes;                    // Closes of the current step (see begin_step)
+    std::vector<double> step_changes;                   // Price changes of the current step
+    std::vector<char> priced;                           // Whether each ticker has a record with a price
+    size_t unpriced = 0;                                // Number of tickers without one
+};
+
+/**
+ * @struct Ledger_Reader
+ * @brief Read-only, memory-mapped view of a ledger file.
+ *
+ * The records are used in place, without parsing or copying, so queries run at memory speed.
+ * A partly written record at the end of the file is ignored.
+ */
+struct Ledger_Reader {
+    /**
+     * @brief Maps a ledger file.
+     *
+     * @param filename The ledger file.
+     * @throws std::runtime_error If the file cannot be read or is not a ledger.
+     */
+    explicit Ledger_Reader(const std::string& filename) {
+        std::ifstream in(filename, std::ios::binary);
+        std::uint64_t header_bytes = 0;
+        if (!in || !Ledger_File::read_header(in, symbols, header_bytes)) {
+            throw std::runtime_error("Ledger_Reader: " + filename + " is not a ledger");
+        }
+        in.close();
+
+        int fd = open(filename.c_str(), O_RDONLY);
+        struct stat file_stat;
+        if (fd < 0 || fstat(fd, &file_stat) != 0 || static_cast<std::uint64_t>(file_stat.st_size) < header_bytes) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("Ledger_Reader: cannot read " + filename);
+        }
+        size = static_cast<size_t>(file_stat.st_size);
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            throw std::runtime_error("Ledger_Reader: cannot map " + filename);
+        }
+        data = mapped;
+        first = reinterpret_cast<const Ledger_Record*>(static_cast<const char*>(data) + header_bytes);
+        n_records = (size - header_bytes) / sizeof(Ledger_Record);
+    }
+
+    ~Ledger_Reader() {
+        munmap(data, size);
+    }
+
+    Ledger_Reader(const Ledger_Reader&) = delete;
+    Ledger_Reader& operator=(const Ledger_Reader&) = delete;
+
+    /**
+     * @brief The records, in the order they were appended.
+     */
+    std::span<const Ledger_Record> records() const {
+        return {first, n_records};
+    }
+
+    Symbol_Table symbols;   // Tickers the records' IDs refer to
+
+private:
+    void* data = nullptr;
+    size_t size = 0;
+    const Ledger_Record* first = nullptr;
+    size_t n_records = 0;
+};
+
+/**
+ * @brief Returns the records up to (and including) a timestamp, found by binary search.
+ */
+std::span<const Ledger_Record> records_until(std::span<const Ledger_Record> records, long timestamp) {
+    auto last = std::upper_bound(records.begin(), records.end(), timestamp,
+                                 [](long value, const Ledger_Record& record) { return value < record.timestamp; });
+    return records.first(static_cast<size_t>(last - records.begin()));
+}
+
+/**
+ * @brief Replays a ledger: the value of each position at the end of a time step.
+ *
+ * Each position is its last record's, revalued from the record's price to the given one.
+ *
+ * @param records The records of the ledger.
+ * @param n_tickers The number of tickers.
+ * @param timestamp The time step to stop at (every record by default).
+ * @param prices The close of each ticker at that time step; without a price (or with none given)
+ *               a position keeps the value of its last record.
+ * @return The value of each ticker's position, indexed by Ticker_Id (0 before its first record).
+ */
+std::vector<double> replay_portfolio(std::span<const Ledger_Record> records, size_t n_tickers,
+                                     long timestamp = std::numeric_limits<long>::max(),
+                                     std::span<const double> prices = {}) {
+    std::vector<double> portfolio(n_tickers, 0.0);
+    std::vector<double> valued_at(n_tickers, std::numeric_limits<double>::quiet_NaN());
+    for (const Ledger_Record& record : records_until(records, timestamp)) {
+        if (record.stock < n_tickers) {
+            portfolio[record.stock] = record.position;
+            valued_at[record.stock] = record.price;
+        }
+    }
+    for (Ticker_Id stock = 0; stock < n_tickers && stock < prices.size(); ++stock) {
+        if (valued_at[stock] > 0.0 && !std::isnan(prices[stock])) {
+            portfolio[stock] *= prices[stock] / valued_at[stock];
+        }
+    }
+    return portfolio;
+}
+
+/**
+ * @brief Profit of each ticker from its price moves.
+ *
+ * Between two records, the position held after the first one gains or loses its price move
+ * up to the second; after the last record, the move up to the given final price.
+ *
+ * @param records The records of the ledger.
+ * @param n_tickers The number of tickers.
+ * @param prices The last close of each ticker (the open positions' moves are left out without them).
+ * @return The profit of each ticker, indexed by Ticker_Id.
+ */
+std::vector<double> ticker_profit(std::span<const Ledger_Record> records, size_t n_tickers,
+                                  std::span<const double> prices = {}) {
+    std::vector<double> profit(n_tickers, 0.0);
+    std::vector<double> position(n_tickers, 0.0);
+    std::vector<double> valued_at(n_tickers, std::numeric_limits<double>::quiet_NaN());
+    for (const Ledger_Record& record : records) {
+        Ticker_Id stock = record.stock;
+        if (stock >= n_tickers) {
+            continue;
+        }
+        if (valued_at[stock] > 0.0 && !std::isnan(record.price)) {
+            profit[stock] += position[stock] * (record.price / valued_at[stock] - 1.0);
+        }
+        position[stock] = record.position;
+        if (!std::isnan(record.price)) {
+            valued_at[stock] = record.price;
+        }
+    }
+    for (Ticker_Id stock = 0; stock < n_tickers && stock < prices.size(); ++stock) {
+        if (valued_at[stock] > 0.0 && !std::isnan(prices[stock])) {
+            profit[stock] += position[stock] * (prices[stock] / valued_at[stock] - 1.0);
+        }
+    }
+    return profit;
+}
+
+/**
+ * @brief Value traded (sold plus allocated) on each day with trades.
+ *
+ * @param records The records of the ledger.
+ * @return Pairs of the day (timestamp of its midnight, UTC) and the value traded, in date order.
+ */
+std::vector<std::pair<long, double>> turnover_by_day(std::span<const Ledger_Record> records) {
+    std::vector<std::pair<long, double>> turnover;
+    for (const Ledger_Record& record : records) {
+        if (record.type != Ledger_Type::Sell && record.type != Ledger_Type::Allocate) {
+            continue;
+        }
+        long day = static_cast<long>(record.timestamp) / 86400 * 86400;
+        if (turnover.empty() || turnover.back().first != day) {
+            turnover.emplace_back(day, 0.0);
+        }
+        turnover.back().second += record.amount;
+    }
+    return turnover;
+}
@@ -1,9 +1,20 @@
 #include "volatility_formula.h"
 #include "portfolio_manager.h"
 #include "stock_manager.h"
-#include "volatility_parse.h"
+#include "simulation.h"
+#include "checkpoint.h"
+#include "metrics.h"
+#include "ledger.h"
+#include "time_index.h"
+#include "task_graph.h"
 #include "extractor.h"
+#include "ohlcv.h"
+#include "symbol_table.h"
+#include "covariance_engine.h"
 #include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <memory>
 #include <cmath>
 #include <map>
 #include <vector>
@@ -15,19 +26,20 @@
 #include <algorithm>
 #include <cctype>
 #include <iomanip>
-#include <matplot/matplot.h>
-using namespace matplot;
+#include <thread>
+#include "plotting.h"
 
 
 /**
  * @brief Initializes the game and sets up initial variables.
  * 
- * Prompts the user for initial investment, strategy, and duration in months. 
+ * Prompts the user for initial investment, strategy, allocation mode (and cap per stock), trading costs, volatility thresholds, and duration in months. 
  * Validates the input and applies default values if the user input is invalid.
  * 
- * @return A tuple containing the initial investment, number of months, and investment strategy.
+ * @return A tuple containing the initial investment, number of months, investment strategy, allocation mode, execution mode, threshold mode,
+ *         largest share of one stock, and interval of the downloaded bars.
  */
-std::tuple<float, int, std::string> start_game() {
+std::tuple<float, int, std::string, std::string, std::string, std::string, double, std::string> start_game() {
     std::cout << "Welcome to Stock Shock. Today is 1st of January of 2023. Let's test your investment skills.\n";
     std::cout << "You will have a series of decisions to make which will affect how your money behaves, so choose wisely!\n";
 
@@ -78,46 +90,109 @@ std::tuple<float, int, std::string> start_game() {
         strategy = "conservative";
     }
 
-    return std::make_tuple(initial_investment, months, strategy);
+    // allocation mode
+    std::string allocation_mode = "strategy";
+    std::cout << "\nHow should freed-up funds be allocated? (Strategy, Min-Variance, Risk-Parity, Mean-Variance, or type 'you choose'):\n";
+    std::cout << "Strategy: Split by the volatility weights of your strategy.\n";
+    std::cout << "Min-Variance: Aim for the least risky mix of stocks, taking co-movement into account.\n";
+    std::cout << "Risk-Parity: Aim for every stock contributing the same amount of risk.\n";
+    std::cout << "Mean-Variance: Trade off recent returns against risk (risk appetite follows your strategy).\n";
+    std::cout << "Pick your allocation mode: ";
+    getline(std::cin, input);
+    std::transform(input.begin(), input.end(), input.begin(),
+                   [](unsigned char c){ return std::tolower(c); });
+    if (input == "min-variance") {
+        allocation_mode = "min_variance";
+    } else if (input == "risk-parity") {
+        allocation_mode = "risk_parity";
+    } else if (input == "mean-variance") {
+        allocation_mode = "mean_variance";
+    }
+
+    // largest share of one stock (optimized allocation modes only)
+    double max_weight = 0.25;
+    if (allocation_mode != "strategy") {
+        std::cout << "\nWhat is the largest share of your portfolio one stock may take? (1-100%, or type 'you choose'): ";
+        getline(std::cin, input);
+        if (input != "you choose") {
+            try {
+                double percent = std::stod(input);
+                if (percent < 1 || percent > 100) throw std::out_of_range("Must be between 1 and 100");
+                max_weight = percent / 100.0;
+            } catch (std::exception&) {
+                std::cout << "Invalid input. Using default of 25%." << std::endl;
+                max_weight = 0.25;
+            }
+        }
+    }
+
+    // execution mode
+    std::string execution_mode = "instant";
+    std::cout << "\nHow should trades be filled? (Instant, Costs, Order-Book, or type 'you choose'):\n";
+    std::cout << "Instant: Trades fill at the last price for free.\n";
+    std::cout << "Costs: Pay fees, the bid-ask spread, and market impact on every trade.\n";
+    std::cout << "Order-Book: Trades walk a simulated order book built from each hour's volume, plus fees.\n";
+    std::cout << "Pick your execution mode: ";
+    getline(std::cin, input);
+    std::transform(input.begin(), input.end(), input.begin(),
+                   [](unsigned char c){ return std::tolower(c); });
+    if (input == "costs") {
+        execution_mode = "costs";
+    } else if (input == "order-book") {
+        execution_mode = "order_book";
+    }
+
+    // threshold mode
+    std::string threshold_mode = "fixed";
+    std::cout << "\nWhat counts as too volatile? (Fixed, Per-Stock, Market, or type 'you choose'):\n";
+    std::cout << "Fixed: The hourly volatility levels the strategies were tuned with on large tech stocks.\n";
+    std::cout << "Per-Stock: Compare each stock with its own past volatility (percentiles, learned as the game goes).\n";
+    std::cout << "Market: Compare each stock with the past volatility of all stocks.\n";
+    std::cout << "Pick your thresholds: ";
+    getline(std::cin, input);
+    std::transform(input.begin(), input.end(), input.begin(),
+                   [](unsigned char c){ return std::tolower(c); });
+    if (input == "per-stock") {
+        threshold_mode = "ticker";
+    } else if (input == "market") {
+        threshold_mode = "universe";
+    }
+
+    // bar interval
+    std::string bar_interval = "1h";
+    std::cout << "\nWhich price bars should be downloaded? (Hourly, 30-Minute, 15-Minute, or type 'you choose'):\n";
+    std::cout << "Hourly: One bar per hour, as the game is played.\n";
+    std::cout << "30-Minute / 15-Minute: Finer bars combined into the hourly steps, for better highs and lows (Yahoo only keeps the last 60 days, so these play the last 59 days).\n";
+    std::cout << "Pick your bars: ";
+    getline(std::cin, input);
+    std::transform(input.begin(), input.end(), input.begin(),
+                   [](unsigned char c){ return std::tolower(c); });
+    if (input == "30-minute") {
+        bar_interval = "30m";
+    } else if (input == "15-minute") {
+        bar_interval = "15m";
+    }
+
+    return std::make_tuple(initial_investment, months, strategy, allocation_mode, execution_mode, threshold_mode, max_weight, bar_interval);
 }
 /**
  * @brief Creates an initial portfolio allocation.
  * 
- * Distributes the initial investment equally among the provided tickers.
+ * Distributes the initial investment equally among the interned tickers.
  * 
- * @param tickers A vector of stock tickers.
+ * @param symbols The symbol table holding the tickers of the portfolio.
  * @param initial_investment The total initial investment amount.
- * @return A map representing the portfolio with tickers as keys and allocated amounts as values.
+ * @return The allocated amount of each ticker, indexed by Ticker_Id.
  */
-std::map<std::string, double> create_portfolio(const std::vector<std::string>& tickers, double initial_investment) {
-    std::map<std::string, double> my_portfolio;
-    if (tickers.empty()) {
+std::vector<double> create_portfolio(const Symbol_Table& symbols, double initial_investment) {
+    if (symbols.size() == 0) {
         std::cerr << "Error: No tickers provided.\n";
-        return my_portfolio;
-    }
-    double price_per_ticker = initial_investment / tickers.size();
-    for (const auto& ticker : tickers) {
-        my_portfolio[ticker] = price_per_ticker;
+        return {};
     }
-
-    return my_portfolio;
+    double price_per_ticker = initial_investment / symbols.size();
+    return std::vector<double>(symbols.size(), price_per_ticker);
 }
 
-/**
- * @brief Calculates the total value of a portfolio.
- * 
- * Iterates through the portfolio map to calculate the sum of all values.
- * 
- * @param portfolio A map representing the portfolio.
- * @return The total value of the portfolio.
- */
-double calculate_total_portfolio_value(const std::map<std::string, double>& portfolio) {
-    double total_value = 0.0;
-    for (const auto& [stock, value] : portfolio) {
-        total_value += value;
-    }
-    return total_value;
-}
 
 
 int main() {
@@ -125,174 +200,326 @@ int main() {
     float initial_investment;
     int months;
     std::string strategy;
+    std::string allocation_mode;
+    std::string execution_mode;
+    std::string threshold_mode;
+    double max_weight;
+    std::string bar_interval;
     //strategy = "neutral";
     //months = 12;
     //initial_investment = 20000;
-    std::tie(initial_investment, months, strategy) = start_game();
+    std::tie(initial_investment, months, strategy, allocation_mode, execution_mode, threshold_mode, max_weight, bar_interval) = start_game();
 
     // GET PRICE PER HOUR -ISMA
-    // Map to store prices for each ticker
-    std::map<std::string, std::vector<double>> ticker_to_prices;
     std::vector<std::string> tickers = {
         "NVDA", "AAPL", "MSFT", "AMZN", "GOOGL",
         "META", "TSLA", "TSM", "AVGO", "ORCL"
     };
+    // A larger universe can be listed in tickers.txt, one symbol per line
+    std::ifstream tickers_file("tickers.txt");
+    if (tickers_file) {
+        std::vector<std::string> listed;
+        std::string line;
+        while (std::getline(tickers_file, line)) {
+            line.erase(std::remove_if(line.begin(), line.end(), [](unsigned char c){ return std::isspace(c); }), line.end());
+            if (!line.empty()) {
+                listed.push_back(line);
+            }
+        }
+        if (!listed.empty()) {
+            tickers = listed;
+        }
+    }
+    // The game steps hourly; Yahoo's US-equity hourly bars start on the half hour (9:30)
+    const std::string step_interval = "1h";
+    const long step_offset = 1800;
+    std::string start_date = "2023-12-30";
+    std::string end_date = "2024-11-18";
+    if (bar_interval != step_interval) {
+        // Yahoo only keeps the last 60 days of finer bars, so those are played over the last 59 days
+        long today = std::time(nullptr) / 86400 * 86400;
+        start_date = convert_to_date(today - 59 * 86400);
+        end_date = convert_to_date(today + 86400);
+    }
+
+    // Intern the tickers once; everything below works on dense ticker IDs
+    Symbol_Table symbols;
     for (const auto& ticker : tickers) {
-        get_stock_data(ticker, "2023-12-30", "2024-11-18", ticker_to_prices);
+        symbols.intern(ticker);
     }
 
+    // Only simulate the months the user asked for; the window is a view of the loaded bars
+    long window_start = convert_to_timestamp(start_date);
+    long window_end = add_months(window_start, months);
+
+    // LOAD EVERY TICKER IN A PIPELINE
+    // Each ticker is downloaded, parsed and derived (prices, changes, range volatility) as its own
+    // chain of tasks, so one ticker's parsing overlaps with another's download. Every task writes
+    // only its own ticker's slot. The simulation below is the only stage that needs all tickers.
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    std::vector<std::string> responses(symbols.size());
+    std::vector<std::vector<Ohlcv_Bar>> ticker_to_bars(symbols.size());
+    std::vector<Bar_Range> window(symbols.size());
+    std::vector<double> parkinson(symbols.size());
+    std::vector<double> garman_klass(symbols.size());
+
+    Task_Graph pipeline;
+    for (Ticker_Id stock = 0; stock < symbols.size(); ++stock) {
+        Task_Graph::Task_Id fetch = pipeline.add_task([&, stock]() {
+            fetch_stock_chart(symbols.name(stock), start_date, end_date, bar_interval, responses[stock]);
+        });
+        Task_Graph::Task_Id parse = pipeline.add_task([&, stock]() {
+            parse_stock_bars(symbols.name(stock), responses[stock], ticker_to_bars[stock]);
+            std::string().swap(responses[stock]); // The raw JSON is no longer needed
+            if (bar_interval != step_interval) {
+                ticker_to_bars[stock] = resample(ticker_to_bars[stock], step_interval, step_offset);
+            }
+        }, {fetch});
+        pipeline.add_task([&, stock]() {
+            window[stock] = slice_bars(ticker_to_bars[stock], window_start, window_end);
+            parkinson[stock] = parkinson_volatility(window[stock]);
+            garman_klass[stock] = garman_klass_volatility(window[stock]);
+        }, {parse});
+    }
+    // Downloads mostly wait on the network, so use a thread per ticker (up to 64) on top of the cores
+    pipeline.run(std::min<size_t>(symbols.size(), 64) + std::thread::hardware_concurrency());
+    curl_global_cleanup();
+
+    // Index the loaded bars for the rolling windows
+    Time_Index time_index(ticker_to_bars);
+
     // GET PORTFOLIO
     // Determine initial investment per stock
-    std::map<std::string,double> my_portfolio = create_portfolio(tickers, initial_investment);
+    Simulation_State state(symbols.size(), strategy, allocation_mode, initial_investment, execution_mode, threshold_mode);
+    state.portfolio = create_portfolio(symbols, initial_investment);
+    state.manager.optimizer.max_weight = max_weight;
+
+    // Offer to resume a previous run over the same tickers
+    const std::string checkpoint_file = "simulation.ckpt";
+    Simulation_State saved_state;
+    bool resumed = false;
+    if (load_checkpoint(checkpoint_file, saved_state, symbols)) {
+        std::cout << "\nFound a saved game after " << saved_state.hours_processed << " hours ("
+                  << saved_state.strategy << ", " << saved_state.manager.allocation_mode
+                  << "). Resume it? (yes/no): ";
+        std::string input;
+        getline(std::cin, input);
+        std::transform(input.begin(), input.end(), input.begin(),
+                       [](unsigned char c){ return std::tolower(c); });
+        if (input == "yes" || input == "y") {
+            state = std::move(saved_state);
+            resumed = true;
+        }
+    }
 
-    // GET VOLATILITY MAP
-    std::map<std::string, double> output = ticker_to_vol_hourly(ticker_to_prices);
-    std::map<std::string, std::vector<double>> true_vol = true_volatility(ticker_to_prices, output);
-    
-    // Calculate percentage changes
-    std::map<std::string, std::vector<double>> ticker_to_percentage_changes =
-        calculate_percentage_changes(ticker_to_prices);
+    // Record every trade in an append-only ledger; a resumed game continues its ledger
+    const std::string ledger_file = "trades.ledger";
+    if (!resumed) {
+        std::filesystem::remove(ledger_file);
+    }
+    std::unique_ptr<Trade_Ledger> ledger;
+    try {
+        ledger = std::make_unique<Trade_Ledger>(ledger_file, symbols);
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << " (trades will not be recorded)\n";
+    }
+    std::vector<double>& my_portfolio = state.portfolio;
 
     // Print the initial portfolio
     std::cout << "Initial Portfolio:\n";
-    for (const auto& [stock, value] : my_portfolio) {
-        std::cout << stock << ": $" << value << "\n";
+    for (Ticker_Id stock = 0; stock < my_portfolio.size(); ++stock) {
+        std::cout << symbols.name(stock) << ": $" << my_portfolio[stock] << "\n";
     }
     std::cout << "--------------------------\n";
 
-    // Call Stock_Manager_Result and get results
-    Stock_Manager_Result stock_result = stock_manager(true_vol, my_portfolio, strategy);
+    // Decimated chart series, collected step by step: the total, its drawdown and the
+    // largest positions at the start, so memory does not grow with the steps or the tickers
+    const size_t chart_width = 1600;
+    Portfolio_History history(largest_positions(my_portfolio, 10), chart_width);
 
-    // Call portfolio_manager and get results
-    Portfolio_Manager_Result portfolio_result = portfolio_manager(
-        stock_result.buying_stocks,
-        stock_result.reallocation_funds,
-        my_portfolio,
-        strategy,
-        true_vol,
-        ticker_to_percentage_changes
-    );
-
-    std::vector<std::map<std::string, double>> portfolio_snapshots;
+    // Co-movement of the hourly returns, for the risk report, built from the timestamp-merged steps;
+    // the optimized allocation modes already keep it in the portfolio manager's state
+    const bool manager_covariance = state.manager.covariance.size() == symbols.size();
+    Ewma_Covariance step_covariance(manager_covariance ? 0 : symbols.size(), state.manager.lambda);
+    std::vector<double> hour_returns(symbols.size());
 
+    // RUN THE SIMULATION hour by hour: volatility, Stock Manager and Portfolio Manager
     // PRINTING RESULTS/PLOT
     // Print combined results for each hour
-    size_t hours = stock_result.buying_stocks.size();
-    for (size_t hour = 0; hour < hours; ++hour) {
-        std::cout << "Hour " << hour + 1 << " Results:\n";
+    auto print_step = [&](const Simulation_Step& step) {
+        if (!manager_covariance) {
+            for (Ticker_Id stock = 0; stock < hour_returns.size(); ++stock) {
+                double percentage_change = step.percentage_changes[stock];
+                hour_returns[stock] = std::isnan(percentage_change) ? 0.0 : percentage_change / 100.0;
+            }
+            step_covariance.update(hour_returns);
+        }
+
+        std::cout << "Hour " << step.hour + 1 << " Results:\n";
 
         // Print the percentage changes for each stock
         std::cout << "  Stock Price Changes:\n";
-        for (const auto& [stock, percentage_changes] : ticker_to_percentage_changes) {
-            double percentage_change = 0.0;
-            if (hour < percentage_changes.size()) {
-                percentage_change = percentage_changes[hour];
-                std::cout << "    " << stock << ": ";
+        for (Ticker_Id stock = 0; stock < step.percentage_changes.size(); ++stock) {
+            double percentage_change = step.percentage_changes[stock];
+            if (!std::isnan(percentage_change)) {
+                std::cout << "    " << symbols.name(stock) << ": ";
                 if (percentage_change >= 0) {
                     std::cout << "+";
                 }
                 std::cout << percentage_change << "%\n";
             } else {
                 // If no data for this hour, assume no change
-                std::cout << "    " << stock << ": No data\n";
+                std::cout << "    " << symbols.name(stock) << ": No data\n";
             }
         }
 
         // Stock Manager Results
         std::cout << "  Stock Manager Decisions:\n";
         std::cout << "    Buying: ";
-        for (const auto& stock : stock_result.buying_stocks[hour]) {
-            std::cout << stock << " ";
+        for (Ticker_Id stock : step.buying_stocks) {
+            std::cout << symbols.name(stock) << " ";
         }
         std::cout << "\n";
 
         std::cout << "    Selling: ";
-        for (const auto& stock : stock_result.selling_stocks[hour]) {
-            std::cout << stock << " ";
+        for (Ticker_Id stock : step.selling_stocks) {
+            std::cout << symbols.name(stock) << " ";
         }
         std::cout << "\n";
 
-        std::cout << "    Funds Available for Reallocation: $" << stock_result.reallocation_funds[hour] << "\n";
+        std::cout << "    Funds Available for Reallocation: $" << step.reallocation_funds << "\n";
 
         // Portfolio Manager Results
         std::cout << "  How much we bought:\n";
-        if (hour < portfolio_result.allocations.size() && !portfolio_result.allocations[hour].empty()) {
-            for (const auto& [stock, allocated_funds] : portfolio_result.allocations[hour]) {
-                std::cout << "    - " << stock << ": $" << allocated_funds << "\n";
+        if (!step.allocations.empty()) {
+            for (const auto& [stock, allocated_funds] : step.allocations) {
+                std::cout << "    - " << symbols.name(stock) << ": $" << allocated_funds << "\n";
             }
         } else {
             std::cout << "    No funds allocated this hour.\n";
         }
 
-                // Print the updated portfolio at the start of the hour
+        // Print the updated portfolio at the end of the hour
         std::cout << "  Your Portfolio at the end of this hour:\n";
-        // Use the stored portfolio values for this hour
-        if (hour < portfolio_result.portfolio_values.size()) {
-            const auto& portfolio_at_hour = portfolio_result.portfolio_values[hour];
-            portfolio_snapshots.push_back(portfolio_result.portfolio_values[hour]);
-            for (const auto& [stock, value] : portfolio_at_hour) {
-                std::cout << "    " << stock << ": $" << value << "\n";
-            }
-        } else {
-            // If for some reason we don't have portfolio values for this hour, print current my_portfolio
-            portfolio_snapshots.push_back(portfolio_snapshots.back());
-            for (const auto& [stock, value] : my_portfolio) {
-                std::cout << "    " << stock << ": $" << value << "\n";
-            }
+        history.add(static_cast<double>(step.hour), step.portfolio, portfolio_value(state));
+        for (Ticker_Id stock = 0; stock < step.portfolio.size(); ++stock) {
+            std::cout << "    " << symbols.name(stock) << ": $" << step.portfolio[stock] << "\n";
         }
         std::cout << "--------------------------\n";
+    };
+
+    run_simulation(state, window, print_step, ledger.get());
+
+    // Save the game so a later run with newer data can pick up from here
+    if (save_checkpoint(checkpoint_file, state, symbols)) {
+        std::cout << "Game saved to " << checkpoint_file << "\n";
+    }
+    if (ledger) {
+        ledger.reset();
+        try {
+            Ledger_Reader reader(ledger_file);
+            std::vector<std::pair<long, double>> daily_turnover = turnover_by_day(reader.records());
+            double traded = 0.0;
+            for (const auto& day : daily_turnover) {
+                traded += day.second;
+            }
+            std::cout << "Trades recorded to " << ledger_file << " (" << reader.records().size() << " records, $"
+                      << (daily_turnover.empty() ? 0.0 : traded / daily_turnover.size()) << " traded per day)\n";
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << " (the trades cannot be summarized)\n";
+        }
     }
 
     // Print final portfolio
     std::cout << "\nYour Final Portfolio:\n";
-    for (const auto& [stock, value] : my_portfolio) {
-        std::cout << stock << ": $" << value << "\n";
+    for (Ticker_Id stock = 0; stock < my_portfolio.size(); ++stock) {
+        std::cout << symbols.name(stock) << ": $" << my_portfolio[stock] << "\n";
     }
 
     // Calculate and print total gain/loss
-    double final_portfolio_value = calculate_total_portfolio_value(my_portfolio);
-    double gain_loss = final_portfolio_value - initial_investment;
+    double final_portfolio_value = portfolio_value(state); // Includes cash left by partial fills
+    double gain_loss = final_portfolio_value - state.initial_investment;
 
     std::cout << "\nTotal Gain/Loss: $";
     if (gain_loss >= 0) {
         std::cout << "+";
     }
-    std::cout << gain_loss << " (" << (gain_loss / initial_investment) * 100 << "%)\n";
+    std::cout << gain_loss << " (" << (gain_loss / state.initial_investment) * 100 << "%)\n";
+
+    // PERFORMANCE METRICS, accumulated hour by hour during the simulation
+    const Performance_Metrics& metrics = state.metrics;
+    std::cout << "\nPerformance over " << metrics.periods() << " hours:\n";
+    std::cout << "  Annualized Volatility: " << metrics.volatility() * 100 << "%\n";
+    std::cout << "  Sharpe Ratio: " << metrics.sharpe_ratio() << "\n";
+    std::cout << "  Sortino Ratio: " << metrics.sortino_ratio() << "\n";
+    std::cout << "  Max Drawdown: " << metrics.max_drawdown * 100 << "%\n";
+    std::cout << "  Turnover: " << metrics.turnover << "x the portfolio\n";
+    std::cout << "  Contribution to the Return:\n";
+    for (Ticker_Id stock = 0; stock < metrics.ticker_contribution.size(); ++stock) {
+        std::cout << "    " << symbols.name(stock) << ": " << metrics.ticker_contribution[stock] * 100
+                  << "% ($" << metrics.ticker_profit[stock] << ")\n";
+    }
 
-    // PLOT the portfolio over time
-    std::map<std::string, std::vector<double>> stock_data;
-    std::vector<double> time_hours(portfolio_snapshots.size());
+    // Trading costs paid along the way
+    if (state.execution.mode != "instant") {
+        std::cout << "\nTrading Costs (" << state.execution.mode << "): $" << state.execution.fees_paid
+                  << " in fees, $" << state.execution.slippage_paid << " in spread and impact, over "
+                  << state.execution.orders << " orders ($" << state.execution.turnover << " traded)\n";
+    }
 
-    for (size_t i = 0; i < portfolio_snapshots.size(); ++i) {
-        time_hours[i] = i;
-        for (const auto& [stock, value] : portfolio_snapshots[i]) {
-            stock_data[stock].push_back(value);
-        }
+    // PORTFOLIO RISK
+    // The EWMA covariance matrix of the simulated hours accounts for co-movement
+    const Ewma_Covariance& covariance = manager_covariance ? state.manager.covariance : step_covariance;
+
+    double portfolio_volatility = std::sqrt(covariance.portfolio_variance(my_portfolio));
+    std::vector<double> marginal_risk = covariance.marginal_risk_contributions(my_portfolio);
+    std::cout << "\nHourly Portfolio Volatility (EWMA): $" << portfolio_volatility << "\n";
+    std::cout << "Share of Portfolio Risk:\n";
+    for (Ticker_Id stock = 0; stock < my_portfolio.size(); ++stock) {
+        double share = portfolio_volatility > 0.0 ? my_portfolio[stock] * marginal_risk[stock] / portfolio_volatility : 0.0;
+        std::cout << "  " << symbols.name(stock) << ": " << share * 100 << "%\n";
+    }
+
+    // Range-based volatility estimates from the high/low data of the hourly bars
+    std::cout << "\nHourly Volatility from Price Ranges (Parkinson / Garman-Klass):\n";
+    for (Ticker_Id stock = 0; stock < symbols.size(); ++stock) {
+        std::cout << "  " << symbols.name(stock) << ": " << parkinson[stock]
+                  << " / " << garman_klass[stock] << "\n";
     }
 
-    auto ax = gca();
-    hold(ax, on); 
-    std::vector<std::string> colors = {
-        "b", "g", "r", "c", "m", "y", "k",
-        "#b", "g", "r"};
-    std::vector<std::string> markers = {"*", "*", "*", "*", "*", "*", "*", "x", "x", "x"};
-    size_t color_index = 0;
-
-    for (const auto& [stock, values] : stock_data) {
-        auto line = plot(time_hours, values);
-        (*line).line_width(2);
-        (*line).color(colors[color_index % colors.size()]);
-        (*line).marker_size(8);
-        (*line).display_name(stock);
-        ++color_index;
+    // ROLLING WINDOWS
+    // Replay the strategy over every 3-month window of the loaded data, reusing the same bars
+    const int rolling_months = 3;
+    std::cout << "\nRolling " << rolling_months << "-Month Returns (" << strategy << ", " << allocation_mode << "):\n";
+    Performance_Metrics rolling_metrics(symbols.size());
+    for (const auto& [window_start, window_end] : rolling_month_windows(time_index.first_timestamp, time_index.last_timestamp + 1, rolling_months, 1)) {
+        Simulation_State rolling_state(symbols.size(), strategy, allocation_mode, initial_investment, execution_mode, threshold_mode);
+        rolling_state.portfolio = create_portfolio(symbols, initial_investment);
+        rolling_state.manager.optimizer.max_weight = max_weight;
+        run_simulation(rolling_state, time_index.slice(window_start, window_end));
+        rolling_metrics.merge(rolling_state.metrics);
+
+        long year;
+        unsigned month;
+        unsigned day;
+        civil_from_days(window_start / 86400, year, month, day);
+        double window_return = portfolio_value(rolling_state) / initial_investment - 1.0;
+        std::cout << "  From " << year << "-" << std::setw(2) << std::setfill('0') << month << "-"
+                  << std::setw(2) << day << std::setfill(' ') << ": ";
+        if (window_return >= 0) {
+            std::cout << "+";
+        }
+        std::cout << window_return * 100 << "%\n";
     }
+    std::cout << "  All windows: Sharpe Ratio " << rolling_metrics.sharpe_ratio() << ", worst Max Drawdown "
+              << rolling_metrics.max_drawdown * 100 << "%\n";
 
-    xlabel("Hour");
-    ylabel("Portfolio value ($)");
-    title("Portfolio Over Hours per Ticker");
-    legend()->location(legend::general_alignment::bottomright);
-    hold(ax, off);
-    show();
+    // PLOT the portfolio over time
+    // Series are decimated to the chart width and rendered to a file, so no display is needed
+    const std::string chart_file = "portfolio.png";
+    if (render_portfolio_charts(chart_file, history, symbols, chart_width)) {
+        std::cout << "\nCharts saved to " << chart_file << "\n";
+    }
 
     return 0;
 
@@ -0,0 +1,208 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "symbol_table.h"
+
+/**
+ * @struct Running_Moments
+ * @brief Count, mean and variance of a stream of values in constant memory.
+ *
+ * Values are added one at a time with Welford's update; two streams are combined with
+ * the pairwise formula of Chan et al., so partial results from parallel runs merge exactly.
+ */
+struct Running_Moments {
+    /**
+     * @brief Adds a value.
+     */
+    void update(double value) {
+        ++n;
+        double delta = value - mean;
+        mean += delta / static_cast<double>(n);
+        m2 += delta * (value - mean);
+    }
+
+    /**
+     * @brief Adds every value seen by another accumulator.
+     */
+    void merge(const Running_Moments& other) {
+        if (other.n == 0) {
+            return;
+        }
+        double total = static_cast<double>(n + other.n);
+        double delta = other.mean - mean;
+        mean += delta * static_cast<double>(other.n) / total;
+        m2 += other.m2 + delta * delta * static_cast<double>(n) * static_cast<double>(other.n) / total;
+        n += other.n;
+    }
+
+    /**
+     * @brief Sample variance (NaN with fewer than two values).
+     */
+    double variance() const {
+        return n > 1 ? m2 / static_cast<double>(n - 1) : std::numeric_limits<double>::quiet_NaN();
+    }
+
+    std::uint64_t n = 0;    // Number of values
+    double mean = 0.0;      // Mean of the values
+    double m2 = 0.0;        // Sum of squared deviations from the mean
+};
+
+/**
+ * @struct Performance_Metrics
+ * @brief Streaming performance statistics of a portfolio, updated once per time step.
+ *
+ * Every statistic is an online accumulator, so a run of any length is summarized without
+ * storing its history: the per-period returns (mean, volatility, Sharpe and Sortino ratios),
+ * the compounded return, the running peak and maximum drawdown, the turnover, and each
+ * ticker's profit and contribution to the return. Memory is constant in the number of
+ * periods (one entry per ticker for the contributions).
+ *
+ * Metrics of separate backtests (e.g., rolling windows run in parallel) can be merged: the
+ * return statistics then cover the periods of both, the drawdown is the worse of the two,
+ * and turnover, profits and contributions add up.
+ */
+struct Performance_Metrics {
+    /**
+     * @brief Creates empty metrics.
+     *
+     * @param n_tickers The number of tickers.
+     * @param periods_per_year The number of time steps in a year, used to annualize (hourly bars: 7 per trading day).
+     */
+    explicit Performance_Metrics(size_t n_tickers = 0, double periods_per_year = 252.0 * 7.0)
+        : periods_per_year(periods_per_year),
+          ticker_profit(n_tickers, 0.0),
+          ticker_contribution(n_tickers, 0.0) {}
+
+    /**
+     * @brief Sets the portfolio value the first return is measured from, unless it is already set.
+     */
+    void start(double value) {
+        if (std::isnan(last_value)) {
+            last_value = value;
+            peak_value = std::max(peak_value, value);
+        }
+    }
+
+    /**
+     * @brief Adds a ticker's profit from price moves during the current period.
+     *
+     * Call before update, so the contribution is measured against the value at the start of the period.
+     *
+     * @param stock The ticker.
+     * @param profit The change in the value of the ticker's position due to its price change.
+     */
+    void add_ticker_profit(Ticker_Id stock, double profit) {
+        if (stock >= ticker_profit.size()) {
+            ticker_profit.resize(stock + 1, 0.0);
+            ticker_contribution.resize(stock + 1, 0.0);
+        }
+        ticker_profit[stock] += profit;
+        if (last_value > 0.0) {
+            ticker_contribution[stock] += profit / last_value;
+        }
+    }
+
+    /**
+     * @brief Closes a period.
+     *
+     * @param value The value of the portfolio at the end of the period.
+     * @param traded_value The value sold plus the value bought during the period.
+     */
+    void update(double value, double traded_value) {
+        if (last_value > 0.0) {
+            double period_return = value / last_value - 1.0;
+            returns.update(period_return);
+            if (period_return < 0.0) {
+                downside_sum_squares += period_return * period_return;
+            }
+            log_growth += std::log1p(period_return);
+            turnover += traded_value / (2.0 * last_value);
+        }
+        traded += traded_value;
+        peak_value = std::max(peak_value, value);
+        if (peak_value > 0.0) {
+            max_drawdown = std::max(max_drawdown, 1.0 - value / peak_value);
+        }
+        last_value = value;
+    }
+
+    /**
+     * @brief Adds the periods of another, separate backtest.
+     */
+    void merge(const Performance_Metrics& other) {
+        returns.merge(other.returns);
+        downside_sum_squares += other.downside_sum_squares;
+        log_growth += other.log_growth;
+        turnover += other.turnover;
+        traded += other.traded;
+        max_drawdown = std::max(max_drawdown, other.max_drawdown);
+        if (ticker_profit.size() < other.ticker_profit.size()) {
+            ticker_profit.resize(other.ticker_profit.size(), 0.0);
+            ticker_contribution.resize(other.ticker_contribution.size(), 0.0);
+        }
+        for (Ticker_Id stock = 0; stock < other.ticker_profit.size(); ++stock) {
+            ticker_profit[stock] += other.ticker_profit[stock];
+            ticker_contribution[stock] += other.ticker_contribution[stock];
+        }
+    }
+
+    /**
+     * @brief Number of periods with a return.
+     */
+    std::uint64_t periods() const {
+        return returns.n;
+    }
+
+    /**
+     * @brief Compounded return over all periods.
+     */
+    double total_return() const {
+        return std::expm1(log_growth);
+    }
+
+    /**
+     * @brief Annualized volatility of the period returns.
+     */
+    double volatility() const {
+        return std::sqrt(returns.variance() * periods_per_year);
+    }
+
+    /**
+     * @brief Annualized Sharpe ratio.
+     *
+     * @param risk_free_rate The annual risk-free rate.
+     */
+    double sharpe_ratio(double risk_free_rate = 0.0) const {
+        double excess = returns.mean - risk_free_rate / periods_per_year;
+        return excess / std::sqrt(returns.variance()) * std::sqrt(periods_per_year);
+    }
+
+    /**
+     * @brief Annualized Sortino ratio: like the Sharpe ratio, but only losses count as risk.
+     *
+     * @param risk_free_rate The annual risk-free rate.
+     */
+    double sortino_ratio(double risk_free_rate = 0.0) const {
+        if (returns.n == 0) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        double excess = returns.mean - risk_free_rate / periods_per_year;
+        double downside_deviation = std::sqrt(downside_sum_squares / static_cast<double>(returns.n));
+        return excess / downside_deviation * std::sqrt(periods_per_year);
+    }
+
+    double periods_per_year;                                            // Periods in a year, to annualize
+    Running_Moments returns;                                            // Per-period returns
+    double downside_sum_squares = 0.0;                                  // Sum of squared negative returns
+    double log_growth = 0.0;                                            // Sum of log(1 + return)
+    double last_value = std::numeric_limits<double>::quiet_NaN();       // Portfolio value at the end of the last period
+    double peak_value = 0.0;                                            // Highest portfolio value so far
+    double max_drawdown = 0.0;                                          // Largest fall from a peak, as a fraction of the peak
+    double turnover = 0.0;                                              // Sum of the one-way traded fraction of the portfolio
+    double traded = 0.0;                                                // Total value sold and bought
+    std::vector<double> ticker_profit;                                  // Profit of each ticker from its price moves
+    std::vector<double> ticker_contribution;                            // Sum of each ticker's share of the period returns
+};
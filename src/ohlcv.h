@@ -0,0 +1,213 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility> // For std::move
+#include <vector>
+#include "volatility_formula.h"
+
+/**
+ * @struct Ohlcv_Bar
+ * @brief One open/high/low/close/volume bar.
+ *
+ * The timestamp is the Unix time at which the bar starts.
+ */
+struct Ohlcv_Bar {
+    long timestamp = 0;
+    double open = 0.0;
+    double high = 0.0;
+    double low = 0.0;
+    double close = 0.0;
+    double volume = 0.0;
+};
+
+/**
+ * @struct Bar_Range
+ * @brief Read-only view of a contiguous run of bars owned by someone else.
+ *
+ * Used to hand sub-ranges of loaded series to the simulation without copying them.
+ * The view is only valid while the underlying vector is alive and unchanged.
+ */
+struct Bar_Range {
+    Bar_Range() = default;
+    Bar_Range(const Ohlcv_Bar* first, const Ohlcv_Bar* last) : first(first), last(last) {}
+    Bar_Range(const std::vector<Ohlcv_Bar>& bars) : first(bars.data()), last(bars.data() + bars.size()) {}
+
+    const Ohlcv_Bar* begin() const { return first; }
+    const Ohlcv_Bar* end() const { return last; }
+    size_t size() const { return static_cast<size_t>(last - first); }
+    bool empty() const { return first == last; }
+    const Ohlcv_Bar& operator[](size_t i) const { return first[i]; }
+
+    const Ohlcv_Bar* first = nullptr;  // First bar of the range
+    const Ohlcv_Bar* last = nullptr;   // One past the last bar of the range
+};
+
+/**
+ * @brief Converts a Yahoo Finance interval string into a number of seconds.
+ *
+ * @param interval The interval (e.g., "1m", "5m", "1h", "60m", "1d", "1wk").
+ * @return The length of the interval in seconds.
+ * @throws std::invalid_argument If the interval has no fixed length (e.g., "1mo") or cannot be parsed.
+ */
+long interval_seconds(const std::string& interval) {
+    size_t unit_start = interval.find_first_not_of("0123456789");
+    if (unit_start == 0 || unit_start == std::string::npos) {
+        throw std::invalid_argument("Invalid interval: " + interval);
+    }
+    long count = std::stol(interval.substr(0, unit_start));
+    std::string unit = interval.substr(unit_start);
+
+    if (unit == "m") {
+        return count * 60;
+    } else if (unit == "h") {
+        return count * 3600;
+    } else if (unit == "d") {
+        return count * 86400;
+    } else if (unit == "wk") {
+        return count * 7 * 86400;
+    }
+    throw std::invalid_argument("Interval without a fixed length: " + interval);
+}
+
+/**
+ * @struct Bar_Resampler
+ * @brief Aggregates fine bars into coarser ones in a single streaming pass.
+ *
+ * Bars are bucketed by timestamp into periods aligned to the Unix epoch plus an offset
+ * (so daily bars follow UTC days, which contain a whole US trading session, and an offset
+ * of 1800 puts hourly buckets on the half hour, like Yahoo's US-equity hourly bars that
+ * start at 9:30). Each coarse bar is
+ * handed to the emit callback as soon as the first bar of the next period arrives.
+ * Resamplers can be chained by pushing from one emit callback into the next resampler,
+ * e.g. 1m -> 5m -> 1h -> 1d, without materializing the intermediate series.
+ */
+struct Bar_Resampler {
+    /**
+     * @brief Creates a resampler.
+     *
+     * @param period The length of the coarse bars in seconds (see interval_seconds).
+     * @param emit Called with every completed coarse bar.
+     * @param offset Seconds after the epoch-aligned boundary at which every coarse bar starts.
+     */
+    Bar_Resampler(long period, std::function<void(const Ohlcv_Bar&)> emit, long offset = 0)
+        : period(period), offset(offset), emit(std::move(emit)) {
+        if (period <= 0) {
+            throw std::invalid_argument("Bar_Resampler: period must be positive");
+        }
+    }
+
+    /**
+     * @brief Adds the next fine bar; bars must arrive in timestamp order.
+     */
+    void push(const Ohlcv_Bar& bar) {
+        long shifted = bar.timestamp - offset;
+        long bucket = bar.timestamp - ((shifted % period) + period) % period;
+        if (has_bar && bucket != current.timestamp) {
+            emit(current);
+            has_bar = false;
+        }
+        if (!has_bar) {
+            current = bar;
+            current.timestamp = bucket;
+            has_bar = true;
+            return;
+        }
+        current.high = std::max(current.high, bar.high);
+        current.low = std::min(current.low, bar.low);
+        current.close = bar.close;
+        current.volume += bar.volume;
+    }
+
+    /**
+     * @brief Emits the last, possibly incomplete, coarse bar.
+     */
+    void flush() {
+        if (has_bar) {
+            emit(current);
+            has_bar = false;
+        }
+    }
+
+    long period;                                  // Length of the coarse bars in seconds
+    long offset;                                  // Start of the buckets past the epoch-aligned boundary
+    std::function<void(const Ohlcv_Bar&)> emit;   // Receives every completed coarse bar
+    Ohlcv_Bar current;                            // Coarse bar being built
+    bool has_bar = false;                         // Whether current holds any fine bar yet
+};
+
+/**
+ * @brief Resamples a series of bars into coarser bars.
+ *
+ * @param bars The fine bars, in timestamp order.
+ * @param interval The interval of the coarse bars (e.g., "1h", "1d").
+ * @param offset Seconds after the epoch-aligned boundary at which every coarse bar starts (see Bar_Resampler).
+ * @return The coarse bars.
+ */
+std::vector<Ohlcv_Bar> resample(const std::vector<Ohlcv_Bar>& bars, const std::string& interval, long offset = 0) {
+    std::vector<Ohlcv_Bar> resampled;
+    Bar_Resampler resampler(interval_seconds(interval), [&resampled](const Ohlcv_Bar& bar) {
+        resampled.push_back(bar);
+    }, offset);
+    for (const auto& bar : bars) {
+        resampler.push(bar);
+    }
+    resampler.flush();
+    return resampled;
+}
+
+/**
+ * @brief Extracts the closing prices of a series of bars.
+ *
+ * @tparam T The value type of the prices (double, or float to halve their memory).
+ * @param bars The bars.
+ * @return The closing price of each bar.
+ */
+template <typename T = double>
+std::vector<T> closing_prices(const Bar_Range& bars) {
+    std::vector<T> closes;
+    closes.reserve(bars.size());
+    for (const auto& bar : bars) {
+        closes.push_back(static_cast<T>(bar.close));
+    }
+    return closes;
+}
+
+/**
+ * @brief Estimates the per-bar volatility from the high-low ranges (Parkinson).
+ *
+ * @param bars The bars; bars with a non-positive low are skipped.
+ * @return The square root of the average Parkinson variance, 0 if no bar is usable.
+ */
+double parkinson_volatility(const Bar_Range& bars) {
+    double variance = 0.0;
+    size_t count = 0;
+    for (const auto& bar : bars) {
+        if (bar.low > 0.0 && bar.high >= bar.low) {
+            variance += VolatilityFunctions::parkinson_variance(bar.high, bar.low);
+            ++count;
+        }
+    }
+    return count > 0 ? std::sqrt(variance / count) : 0.0;
+}
+
+/**
+ * @brief Estimates the per-bar volatility from open, high, low and close (Garman-Klass).
+ *
+ * @param bars The bars; bars with a non-positive price are skipped.
+ * @return The square root of the average Garman-Klass variance, 0 if no bar is usable.
+ */
+double garman_klass_volatility(const Bar_Range& bars) {
+    double variance = 0.0;
+    size_t count = 0;
+    for (const auto& bar : bars) {
+        if (bar.low > 0.0 && bar.open > 0.0 && bar.close > 0.0 && bar.high >= bar.low) {
+            variance += VolatilityFunctions::garman_klass_variance(bar.open, bar.high, bar.low, bar.close);
+            ++count;
+        }
+    }
+    return count > 0 ? std::sqrt(std::max(variance, 0.0) / count) : 0.0;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <matplot/matplot.h>
+#include "decimation.h"
+#include "symbol_table.h"
+
+/**
+ * @brief Renders the total portfolio, drawdown and per-ticker panels to an image file.
+ *
+ * The history is already decimated while the simulation runs (see Portfolio_History); each
+ * series is reduced once more to the pixel width of the chart before it is handed to matplot,
+ * so long (e.g., minute) histories render quickly. The figure is rendered in quiet mode and
+ * saved to a file, so no display is needed.
+ *
+ * @param filename The output file; the extension picks the format (e.g., ".png", ".svg").
+ * @param history The decimated total, drawdown and per-ticker series.
+ * @param symbols The symbol table, used to label the per-ticker lines.
+ * @param width The width of the chart in pixels; also the point budget of each series.
+ * @param height The height of the chart in pixels.
+ * @param method The decimation method ("lttb" or "minmax").
+ * @return Whether the file was written.
+ */
+bool render_portfolio_charts(const std::string& filename,
+                             const Portfolio_History& history,
+                             const Symbol_Table& symbols,
+                             size_t width = 1600,
+                             size_t height = 1200,
+                             const std::string& method = "lttb") {
+    using namespace matplot;
+
+    auto f = figure(true);
+    f->size(static_cast<unsigned>(width), static_cast<unsigned>(height));
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> plot_x;
+    std::vector<double> plot_y;
+
+    auto ax = subplot(f, 3, 1, 0);
+    history.total.points(x, y);
+    decimate(x, y, width, method, plot_x, plot_y);
+    plot(ax, plot_x, plot_y)->line_width(2);
+    title(ax, "Total Portfolio Value");
+    ylabel(ax, "Value ($)");
+
+    ax = subplot(f, 3, 1, 1);
+    history.drawdown.points(x, y);
+    decimate(x, y, width, method, plot_x, plot_y);
+    plot(ax, plot_x, plot_y)->line_width(2).color("r");
+    title(ax, "Drawdown");
+    ylabel(ax, "Below peak (%)");
+
+    ax = subplot(f, 3, 1, 2);
+    hold(ax, on);
+    for (size_t i = 0; i < history.tickers.size(); ++i) {
+        history.ticker_values[i].points(x, y);
+        decimate(x, y, width, method, plot_x, plot_y);
+        plot(ax, plot_x, plot_y)->line_width(2).display_name(symbols.name(history.tickers[i]));
+    }
+    title(ax, "Portfolio Over Hours per Ticker");
+    xlabel(ax, "Hour");
+    ylabel(ax, "Value ($)");
+    legend(ax)->location(legend::general_alignment::topleft);
+    hold(ax, off);
+
+    bool saved = f->save(filename);
+    if (!saved) {
+        std::cerr << "Failed to render charts to " << filename << std::endl;
+    }
+    return saved;
+}
@@ -1,9 +1,17 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <string>
 #include <vector>
 #include <utility> // For std::pair
+#include "symbol_table.h"
+#include "covariance_engine.h"
+#include "allocation_optimizer.h"
+#include "execution.h"
+#include "ledger.h"
 
 /**
  * @struct Portfolio_Manager_Result
@@ -13,31 +21,232 @@
  * at each hour during the simulation.
  */
 struct Portfolio_Manager_Result {
-    std::vector<std::map<std::string, double>> allocations;       // Allocated funds for each stock at each hour
-    std::vector<std::map<std::string, double>> portfolio_values;  // Portfolio values at each hour
+    std::vector<std::vector<std::pair<Ticker_Id, double>>> allocations;  // Allocated funds for each bought stock at each hour
+    std::vector<std::vector<double>> portfolio_values;                   // Portfolio values of each ticker at each hour
 };
 
+/**
+ * @struct Portfolio_Manager_State
+ * @brief State the portfolio manager carries from one hour to the next.
+ *
+ * Only the optimized allocation modes use it: they keep an EWMA covariance matrix and
+ * EWMA expected returns of the hourly returns, and the optimizer's last solution as a warm start.
+ */
+struct Portfolio_Manager_State {
+    /**
+     * @brief Creates the state of a portfolio manager.
+     *
+     * @param n_tickers The number of tickers.
+     * @param allocation_mode How funds are split ("strategy", "min_variance", "risk_parity" or "mean_variance").
+     * @param strategy The investment strategy; sets the risk aversion of "mean_variance".
+     * @param lambda The decay factor of the EWMA estimates.
+     * @param max_weight The largest share of the portfolio the optimizer gives one ticker (raised to 1/n with fewer tickers).
+     */
+    explicit Portfolio_Manager_State(size_t n_tickers = 0,
+                                     const std::string& allocation_mode = "strategy",
+                                     const std::string& strategy = "neutral",
+                                     double lambda = 0.94,
+                                     double max_weight = 0.25)
+        : allocation_mode(allocation_mode),
+          lambda(lambda),
+          covariance(allocation_mode != "strategy" ? n_tickers : 0, lambda),
+          expected_returns(n_tickers, 0.0),
+          hour_returns(n_tickers, 0.0) {
+        optimizer.mode = allocation_mode;
+        optimizer.max_weight = max_weight;
+        if (strategy == "optimistic") {
+            optimizer.risk_aversion = 10.0;
+        } else if (strategy == "conservative") {
+            optimizer.risk_aversion = 200.0;
+        }
+    }
+
+    /**
+     * @brief Whether funds are split by an optimizer instead of the strategy's weights.
+     */
+    bool optimized() const {
+        return allocation_mode != "strategy";
+    }
+
+    std::string allocation_mode;            // "strategy", "min_variance", "risk_parity" or "mean_variance"
+    double lambda;                          // Decay factor of the EWMA estimates
+    Ewma_Covariance covariance;             // Covariance of the hourly returns (optimized modes only)
+    Allocation_Optimizer optimizer;         // Solver, holding the warm start
+    std::vector<double> expected_returns;   // EWMA of the hourly returns
+    std::vector<double> hour_returns;       // Scratch: returns of the current hour
+};
+
+/**
+ * @brief Applies one hour of market changes and allocates the hour's freed-up funds.
+ * 
+ * The portfolio is first moved by the hour's percentage changes. The funds are then split
+ * among the bought stocks: by the strategy's volatility weights in the default "strategy"
+ * allocation mode, or, in the "min_variance", "risk_parity" and "mean_variance" modes, towards
+ * the bought stocks that are furthest below the optimizer's target weights
+ * (see Allocation_Optimizer), which are solved on an EWMA covariance matrix of the hourly returns.
+ * 
+ * @param buying_stocks The stocks to buy this hour.
+ * @param reallocation_funds The funds available for reallocation this hour.
+ * @param my_portfolio A reference to the current portfolio, holding the value of each ticker by Ticker_Id.
+ * @param strategy The investment strategy ("optimistic", "neutral", or "conservative").
+ * @param avg_volatilities A read-only view of the average volatility of each ticker, indexed by Ticker_Id (NaN for tickers without data).
+ * @param percentage_changes A read-only view of the percentage change of each ticker this hour, indexed by Ticker_Id (NaN if it did not trade).
+ * @param state The state carried across hours (see Portfolio_Manager_State).
+ * @param execution Optional execution simulator the purchases are routed through; without one they fill at no cost.
+ * @param ledger Optional trade ledger the allocations are recorded in.
+ * @param filled Optional; receives the value added to each bought position (the allocation less costs), in the order of the allocations.
+ * @return The amount allocated to each bought stock.
+ */
+template <typename T>
+std::vector<std::pair<Ticker_Id, double>> portfolio_manager_hour(
+    const std::vector<Ticker_Id>& buying_stocks,
+    double reallocation_funds,
+    std::vector<double>& my_portfolio,
+    const std::string& strategy,
+    Series_View<T> avg_volatilities,
+    Series_View<T> percentage_changes,
+    Portfolio_Manager_State& state,
+    Execution_Simulator* execution = nullptr,
+    Trade_Ledger* ledger = nullptr,
+    std::vector<double>* filled = nullptr) {
+
+    if (filled) {
+        filled->clear();
+    }
+    // Tickers missing from the portfolio start with nothing invested
+    if (my_portfolio.size() < avg_volatilities.size()) {
+        my_portfolio.resize(avg_volatilities.size(), 0.0);
+    }
+
+    // **Update portfolio for market changes at the start of each hour**
+    for (Ticker_Id stock = 0; stock < my_portfolio.size() && stock < percentage_changes.size(); ++stock) {
+        double percentage_change = percentage_changes[stock];
+        bool traded = !std::isnan(percentage_change);
+        if (traded) {
+            my_portfolio[stock] *= (1.0 + (percentage_change / 100.0)); // Apply percentage change
+        }
+        if (stock < state.hour_returns.size()) {
+            state.hour_returns[stock] = traded ? percentage_change / 100.0 : 0.0;
+        }
+    }
+
+    if (state.optimized()) {
+        state.covariance.update(state.hour_returns);
+        for (Ticker_Id stock = 0; stock < state.expected_returns.size(); ++stock) {
+            state.expected_returns[stock] = state.lambda * state.expected_returns[stock] + (1.0 - state.lambda) * state.hour_returns[stock];
+        }
+    }
+
+    // Allocation for the current hour
+    std::vector<std::pair<Ticker_Id, double>> hour_allocation;
+
+    // Skip this hour if no buying stocks or reallocation funds
+    if (buying_stocks.empty() || reallocation_funds <= 0) {
+        return hour_allocation;
+    }
+
+    // Determine weights for allocation based on strategy and average volatility
+    std::vector<double> allocation_weights;
+    allocation_weights.reserve(buying_stocks.size());
+    double total_weight = 0.0;
+
+    // Target weights of the optimized modes, warm-started from the previous rebalance
+    const std::vector<double>* target = nullptr;
+    double target_value = 0.0;
+    if (state.optimized()) {
+        std::vector<bool> active(avg_volatilities.size());
+        for (Ticker_Id stock = 0; stock < avg_volatilities.size(); ++stock) {
+            active[stock] = !std::isnan(avg_volatilities[stock]);
+        }
+        target = &state.optimizer.solve(state.covariance, state.expected_returns, active);
+        for (double value : my_portfolio) {
+            target_value += value;
+        }
+        target_value += reallocation_funds;
+    }
+
+    for (Ticker_Id stock : buying_stocks) {
+        double avg_volatility = avg_volatilities[stock];
+
+        double weight = 0.0;
+
+        if (target) {
+            // Fill the gap between the target holding and the current one
+            weight = std::max(0.0, (*target)[stock] * target_value - my_portfolio[stock]);
+        } else if (strategy == "optimistic") {
+            weight = 1.0 / (avg_volatility + 0.001); // Inverse relation to volatility
+        } else if (strategy == "neutral") {
+            weight = 1.0;
+        } else if (strategy == "conservative") {
+            weight = 1.0 / (avg_volatility + 0.0005); // Stronger inverse relation
+        }
+
+        allocation_weights.push_back(weight);
+        total_weight += weight;
+    }
+
+    // All bought stocks already at (or above) target: fall back to the target weights, then to equal weights
+    if (total_weight <= 0.0) {
+        for (size_t i = 0; i < buying_stocks.size(); ++i) {
+            allocation_weights[i] = target ? (*target)[buying_stocks[i]] : 0.0;
+            total_weight += allocation_weights[i];
+        }
+    }
+    if (total_weight <= 0.0) {
+        std::fill(allocation_weights.begin(), allocation_weights.end(), 1.0);
+        total_weight = static_cast<double>(allocation_weights.size());
+    }
+
+    // Allocate funds proportionally based on weights
+    for (size_t i = 0; i < buying_stocks.size(); ++i) {
+        Ticker_Id stock = buying_stocks[i];
+        double allocation = (allocation_weights[i] / total_weight) * reallocation_funds;
+
+        // Update the portfolio with the allocated funds (less the costs of buying)
+        double position_change = execution ? execution->buy(stock, allocation).position_change : allocation;
+        my_portfolio[stock] += position_change;
+
+        // Store the allocation result
+        hour_allocation.emplace_back(stock, allocation);
+        if (filled) {
+            filled->push_back(position_change);
+        }
+        if (ledger && allocation > 0.0) {
+            ledger->append(Ledger_Type::Allocate, stock, allocation, my_portfolio[stock]);
+        }
+    }
+
+    return hour_allocation;
+}
+
 /**
  * @brief Manages portfolio allocation and updates based on strategy and market data.
  * 
  * This function updates the portfolio by reallocating funds to stocks based on 
- * the selected strategy, buying decisions, and market conditions.
+ * the selected strategy, buying decisions, and market conditions, one hour at a time
+ * (see portfolio_manager_hour).
  * 
  * @param buying_stocks A vector of stocks to buy at each hour.
  * @param reallocation_funds A vector of funds available for reallocation at each hour.
- * @param my_portfolio A reference to the current portfolio, mapping stock tickers to their values.
+ * @param my_portfolio A reference to the current portfolio, holding the value of each ticker by Ticker_Id.
  * @param strategy The investment strategy ("optimistic", "neutral", or "conservative").
- * @param stocks A map of stock tickers to their volatility data over time.
- * @param ticker_to_percentage_changes A map of stock tickers to their percentage changes over time.
+ * @param stocks The volatility data over time of each ticker, indexed by Ticker_Id (a Basic_Ticker_Series or any other Ticker_Collection).
+ * @param ticker_to_percentage_changes The percentage changes over time of each ticker, indexed by Ticker_Id (any Ticker_Collection).
+ * @param allocation_mode How funds are split ("strategy", "min_variance", "risk_parity" or "mean_variance").
+ * @param max_weight The optimizer's cap on the share of one ticker (see Allocation_Optimizer).
  * @return A Portfolio_Manager_Result object containing allocation and portfolio updates at each hour.
  */
+template <Ticker_Collection Volatilities, Ticker_Collection Changes>
 Portfolio_Manager_Result portfolio_manager(
-    const std::vector<std::vector<std::string>>& buying_stocks,
+    const std::vector<std::vector<Ticker_Id>>& buying_stocks,
     const std::vector<double>& reallocation_funds,
-    std::map<std::string, double>& my_portfolio,
+    std::vector<double>& my_portfolio,
     const std::string& strategy,
-    const std::map<std::string, std::vector<double>>& stocks,
-    const std::map<std::string, std::vector<double>>& ticker_to_percentage_changes) {
+    const Volatilities& stocks,
+    const Changes& ticker_to_percentage_changes,
+    const std::string& allocation_mode = "strategy",
+    double max_weight = 0.25) {
+    using T = Ticker_Value<Volatilities>;
     
     Portfolio_Manager_Result result;
 
@@ -47,75 +256,30 @@ Portfolio_Manager_Result portfolio_manager(
 
     size_t hours = buying_stocks.size();
 
-    for (size_t hour = 0; hour < hours; ++hour) {
-        // **Update portfolio for market changes at the start of each hour**
-        for (auto& [stock, value] : my_portfolio) {
-            // Check if percentage changes exist for this stock
-            if (ticker_to_percentage_changes.count(stock)) {
-                const auto& percentage_changes = ticker_to_percentage_changes.at(stock);
-
-                // Check if there’s a percentage change for the current hour
-                if (hour < percentage_changes.size()) {
-                    double percentage_change = percentage_changes[hour];
-                    value *= (1.0 + (percentage_change / 100.0)); // Apply percentage change
-                }
-            }
+    // Average volatility of each stock over its whole series, computed once up front
+    // (summed in double, stored in the series' value type)
+    std::vector<T> avg_volatilities(stocks.size());
+    for (Ticker_Id stock = 0; stock < stocks.size(); ++stock) {
+        Series_View<T> volatility_values = view_of(stocks[stock]);
+        double sum = 0.0;
+        for (T vol : volatility_values) {
+            sum += vol;
         }
+        avg_volatilities[stock] = static_cast<T>(sum / volatility_values.size());
+    }
 
-        // Allocation for the current hour
-        std::map<std::string, double> hour_allocation;
-
-        // Skip this hour if no buying stocks or reallocation funds
-        if (buying_stocks[hour].empty() || reallocation_funds[hour] <= 0) {
-            // Store current portfolio values
-            result.portfolio_values.push_back(my_portfolio);
-            // Even if no allocation happened, store an empty allocation
-            result.allocations.push_back(hour_allocation);
-            continue;
-        }
-
-        // Determine weights for allocation based on strategy and average volatility
-        std::map<std::string, double> allocation_weights;
-        double total_weight = 0.0;
-
-        for (const auto& stock : buying_stocks[hour]) {
-            const auto& volatility_values = stocks.at(stock);
-            double avg_volatility = 0.0;
-
-            // Calculate average volatility for the stock
-            for (double vol : volatility_values) {
-                avg_volatility += vol;
-            }
-            avg_volatility /= volatility_values.size();
-
-            double weight = 0.0;
-
-            if (strategy == "optimistic") {
-                weight = 1.0 / (avg_volatility + 0.001); // Inverse relation to volatility
-            } else if (strategy == "neutral") {
-                weight = 1.0;
-            } else if (strategy == "conservative") {
-                weight = 1.0 / (avg_volatility + 0.0005); // Stronger inverse relation
-            }
-
-            allocation_weights[stock] = weight;
-            total_weight += weight;
-        }
-
-        // Allocate funds proportionally based on weights
-        for (const auto& stock : buying_stocks[hour]) {
-            double weight = allocation_weights[stock];
-            double allocation = (weight / total_weight) * reallocation_funds[hour];
-
-            // Update the portfolio with the allocated funds
-            my_portfolio[stock] += allocation;
+    Portfolio_Manager_State state(stocks.size(), allocation_mode, strategy, 0.94, max_weight);
+    std::vector<T> hour_changes(ticker_to_percentage_changes.size());
 
-            // Store the allocation result
-            hour_allocation[stock] = allocation;
+    for (size_t hour = 0; hour < hours; ++hour) {
+        // Percentage change of each stock this hour, if there is one
+        for (Ticker_Id stock = 0; stock < ticker_to_percentage_changes.size(); ++stock) {
+            auto percentage_changes = view_of(ticker_to_percentage_changes[stock]);
+            hour_changes[stock] = hour < percentage_changes.size() ? percentage_changes[hour] : std::numeric_limits<T>::quiet_NaN();
         }
 
-        // Add the allocation for this hour to the result
-        result.allocations.push_back(hour_allocation);
+        result.allocations.push_back(portfolio_manager_hour<T>(
+            buying_stocks[hour], reallocation_funds[hour], my_portfolio, strategy, avg_volatilities, hour_changes, state));
 
         // Store the current state of my_portfolio
         result.portfolio_values.push_back(my_portfolio);
@@ -123,6 +287,3 @@ Portfolio_Manager_Result portfolio_manager(
 
     return result;
 }
-
-
-
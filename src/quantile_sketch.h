@@ -0,0 +1,236 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility> // For std::pair
+#include <vector>
+
+/**
+ * @struct Quantile_Sketch
+ * @brief Streaming, mergeable quantile estimates in bounded memory (a KLL sketch).
+ *
+ * Values are kept in levels of compactors; an item at level h stands for 2^h values.
+ * When the sketch is full, the lowest full level is sorted and every other item is
+ * promoted to the next level, so the sketch keeps about 3k items however many values
+ * it has seen. With the default k = 200, quantiles are within about 1.5% in rank.
+ * Sketches built on different threads can be merged into one.
+ * The half that is promoted is picked by a hash of the compaction count instead of a
+ * random generator, so the same values always give the same sketch (and checkpoints replay exactly).
+ */
+struct Quantile_Sketch {
+    /**
+     * @brief Creates an empty sketch.
+     *
+     * @param k The accuracy parameter: the capacity of the top level (at least 8).
+     */
+    explicit Quantile_Sketch(size_t k = 200) : k(std::max<size_t>(k, 8)), levels(1) {
+        recount();
+    }
+
+    /**
+     * @brief Adds a value (NaN values are ignored).
+     */
+    void update(double value) {
+        if (std::isnan(value)) {
+            return;
+        }
+        min_value = std::min(min_value, value);
+        max_value = std::max(max_value, value);
+        ++n;
+        levels[0].push_back(value);
+        if (++n_retained >= capacity_limit) {
+            compress();
+        }
+    }
+
+    /**
+     * @brief Adds every value seen by another sketch.
+     */
+    void merge(const Quantile_Sketch& other) {
+        if (other.n == 0) {
+            return;
+        }
+        if (levels.size() < other.levels.size()) {
+            levels.resize(other.levels.size());
+        }
+        for (size_t h = 0; h < other.levels.size(); ++h) {
+            levels[h].insert(levels[h].end(), other.levels[h].begin(), other.levels[h].end());
+        }
+        n += other.n;
+        min_value = std::min(min_value, other.min_value);
+        max_value = std::max(max_value, other.max_value);
+        recount();
+        compress();
+    }
+
+    /**
+     * @brief Estimates the value at each of several ranks, sorting the sketch only once.
+     *
+     * @param ranks The ranks, between 0 (the minimum) and 1 (the maximum).
+     * @return The estimated value at each rank (NaN if the sketch is empty).
+     */
+    std::vector<double> quantiles(const std::vector<double>& ranks) const {
+        std::vector<double> values(ranks.size(), std::numeric_limits<double>::quiet_NaN());
+        if (n == 0) {
+            return values;
+        }
+        std::vector<std::pair<double, std::uint64_t>> items = weighted_items();
+        std::uint64_t total_weight = 0;
+        for (const auto& item : items) {
+            total_weight += item.second;
+        }
+        for (size_t i = 0; i < ranks.size(); ++i) {
+            if (ranks[i] <= 0.0) {
+                values[i] = min_value;
+                continue;
+            }
+            if (ranks[i] >= 1.0) {
+                values[i] = max_value;
+                continue;
+            }
+            double target = ranks[i] * static_cast<double>(total_weight);
+            std::uint64_t cumulative = 0;
+            values[i] = max_value;
+            for (const auto& item : items) {
+                cumulative += item.second;
+                if (static_cast<double>(cumulative) >= target) {
+                    values[i] = item.first;
+                    break;
+                }
+            }
+        }
+        return values;
+    }
+
+    /**
+     * @brief Estimates the value at a rank (e.g., 0.5 for the median).
+     */
+    double quantile(double rank) const {
+        return quantiles({rank})[0];
+    }
+
+    /**
+     * @brief Estimates the fraction of the values that are less than or equal to a value.
+     */
+    double rank(double value) const {
+        if (n == 0) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        std::uint64_t below = 0;
+        std::uint64_t total_weight = 0;
+        for (size_t h = 0; h < levels.size(); ++h) {
+            for (double item : levels[h]) {
+                total_weight += std::uint64_t(1) << h;
+                if (item <= value) {
+                    below += std::uint64_t(1) << h;
+                }
+            }
+        }
+        return static_cast<double>(below) / static_cast<double>(total_weight);
+    }
+
+    /**
+     * @brief Number of values added so far.
+     */
+    std::uint64_t count() const {
+        return n;
+    }
+
+    /**
+     * @brief Number of items the sketch keeps in memory.
+     */
+    size_t retained() const {
+        size_t total = 0;
+        for (const auto& level : levels) {
+            total += level.size();
+        }
+        return total;
+    }
+
+    /**
+     * @brief Refreshes the cached item count and capacity after the levels were set directly
+     *        (e.g., read from a checkpoint).
+     */
+    void recount() {
+        n_retained = retained();
+        capacity_limit = total_capacity();
+    }
+
+    size_t k;                                                       // Capacity of the top level
+    std::uint64_t n = 0;                                            // Number of values added
+    double min_value = std::numeric_limits<double>::infinity();     // Smallest value added
+    double max_value = -std::numeric_limits<double>::infinity();    // Largest value added
+    std::uint64_t compactions = 0;                                  // Number of compactions, hashed to pick the promoted half
+    std::vector<std::vector<double>> levels;                        // Items of each level; level h items weigh 2^h
+
+private:
+    size_t n_retained = 0;      // Items kept, updated on every insert and compaction
+    size_t capacity_limit = 0;  // Total capacity of the levels, only changes when a level is added
+
+    // Levels shrink geometrically below the top one, by a factor of 2/3
+    size_t capacity(size_t level) const {
+        double scale = std::pow(2.0 / 3.0, static_cast<double>(levels.size() - 1 - level));
+        return std::max<size_t>(2, static_cast<size_t>(std::ceil(k * scale)));
+    }
+
+    size_t total_capacity() const {
+        size_t total = 0;
+        double scale = 1.0;
+        for (size_t h = levels.size(); h-- > 0; scale *= 2.0 / 3.0) {
+            total += std::max<size_t>(2, static_cast<size_t>(std::ceil(k * scale)));
+        }
+        return total;
+    }
+
+    // Compacts the lowest full level until the sketch fits its capacity again
+    void compress() {
+        while (n_retained >= capacity_limit) {
+            size_t h = 0;
+            while (h + 1 < levels.size() && levels[h].size() < capacity(h)) {
+                ++h;
+            }
+            if (h + 1 == levels.size()) {
+                levels.emplace_back();
+                capacity_limit = total_capacity();
+            }
+            std::vector<double>& level = levels[h];
+            std::vector<double>& next = levels[h + 1];
+            std::sort(level.begin(), level.end());
+
+            // With an odd number of items, one stays behind at this level
+            std::uint64_t coin = ++compactions * 0x9E3779B97F4A7C15ull;
+            coin ^= coin >> 31;
+            bool upper_half = ((coin * 0xBF58476D1CE4E5B9ull) >> 63) != 0;
+            size_t first = 0;
+            size_t last = level.size();
+            double kept = 0.0;
+            bool keep_one = level.size() % 2 == 1;
+            if (keep_one) {
+                kept = upper_half ? level[--last] : level[first++];
+            }
+            size_t promoted = next.size();
+            for (size_t i = first + (upper_half ? 1 : 0); i < last; i += 2) {
+                next.push_back(level[i]);
+            }
+            promoted = next.size() - promoted;
+            n_retained -= level.size() - promoted - (keep_one ? 1 : 0);
+            level.clear();
+            if (keep_one) {
+                level.push_back(kept);
+            }
+        }
+    }
+
+    std::vector<std::pair<double, std::uint64_t>> weighted_items() const {
+        std::vector<std::pair<double, std::uint64_t>> items;
+        items.reserve(retained());
+        for (size_t h = 0; h < levels.size(); ++h) {
+            for (double item : levels[h]) {
+                items.emplace_back(item, std::uint64_t(1) << h);
+            }
+        }
+        std::sort(items.begin(), items.end());
+        return items;
+    }
+};
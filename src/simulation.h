@@ -0,0 +1,372 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility> // For std::pair
+#include <vector>
+#include "symbol_table.h"
+#include "ohlcv.h"
+#include "volatility_formula.h"
+#include "stock_manager.h"
+#include "portfolio_manager.h"
+#include "execution.h"
+#include "quantile_sketch.h"
+#include "metrics.h"
+
+/**
+ * @struct Basic_Simulation_State
+ * @brief Everything the simulation carries from one bar to the next.
+ *
+ * The state is complete: saving it (see save_checkpoint) and resuming from it later
+ * gives exactly the same results as replaying the whole history in one run.
+ * Per-ticker vectors are indexed by Ticker_Id.
+ *
+ * @tparam T The value type of the price and volatility series (float halves their memory);
+ *           money (positions, cash) and running sums stay in double.
+ */
+template <typename T>
+struct Basic_Simulation_State {
+    Basic_Simulation_State() = default;
+
+    /**
+     * @brief Creates the state of a new simulation with nothing invested yet.
+     *
+     * @param n_tickers The number of tickers.
+     * @param strategy The investment strategy ("optimistic", "neutral", or "conservative").
+     * @param allocation_mode How funds are split ("strategy", "min_variance", "risk_parity" or "mean_variance").
+     * @param initial_investment The amount invested at the start, used to report gains and losses.
+     * @param execution_mode How orders fill ("instant", "costs" or "order_book", see Execution_Simulator).
+     * @param threshold_mode Where the volatility thresholds come from: "fixed" (the tuned constants), "ticker"
+     *                       (quantiles of each ticker's own volatility) or "universe" (quantiles across all tickers).
+     */
+    Basic_Simulation_State(size_t n_tickers, const std::string& strategy, const std::string& allocation_mode, double initial_investment,
+                           const std::string& execution_mode = "instant", const std::string& threshold_mode = "fixed")
+        : strategy(strategy),
+          initial_investment(initial_investment),
+          threshold_mode(threshold_mode),
+          portfolio(n_tickers, 0.0),
+          volatility(n_tickers, 0.0),
+          volatility_sum(n_tickers, 0.0),
+          volatility_count(n_tickers, 0),
+          last_price(n_tickers, std::numeric_limits<T>::quiet_NaN()),
+          warmup_prices(n_tickers),
+          volatility_sketches(n_tickers),
+          manager(n_tickers, allocation_mode, strategy, lambda),
+          execution(n_tickers, execution_mode),
+          metrics(n_tickers) {}
+
+    // Strategy parameters
+    std::string strategy;                                   // "optimistic", "neutral" or "conservative"
+    double lambda = 0.94;                                   // Decay factor of the volatility EWMA
+    size_t warmup_bars = 6;                                 // Prices used to seed the volatility (as in ticker_to_vol_hourly)
+    double initial_investment = 0.0;                        // Amount invested at the start
+    std::string threshold_mode = "fixed";                   // "fixed", "ticker" or "universe"
+    Quantile_Ranks threshold_quantiles;                     // Ranks of the calibrated thresholds
+    size_t calibration_bars = 24;                           // Volatilities needed before calibrated thresholds are used
+
+    // Progress
+    long last_timestamp = std::numeric_limits<long>::min(); // Timestamp of the last processed bar
+    size_t hours_processed = 0;                             // Number of processed time steps
+
+    // Holdings and per-ticker volatility state
+    std::vector<double> portfolio;                          // Value of each ticker's position
+    std::vector<T> volatility;                              // Current EWMA volatility
+    std::vector<double> volatility_sum;                     // Sum of the EWMA volatilities so far
+    std::vector<size_t> volatility_count;                   // Number of EWMA volatilities so far (0 while warming up)
+    std::vector<T> last_price;                              // Last processed price (NaN before the first bar)
+    Basic_Ticker_Series<T> warmup_prices;                   // First prices, until the volatility is seeded
+    std::vector<Quantile_Sketch> volatility_sketches;       // Distribution of each ticker's volatility ("ticker" thresholds)
+    Quantile_Sketch universe_sketch;                        // Distribution of every ticker's volatility ("universe" thresholds)
+
+    Portfolio_Manager_State manager;                        // Allocation state (covariance, optimizer warm start)
+    Execution_Simulator execution;                          // Fills and transaction costs
+    Performance_Metrics metrics;                            // Returns, drawdown, turnover and contributions so far
+};
+
+/**
+ * @brief The simulation state in the program's series precision (see Series_Value).
+ */
+using Simulation_State = Basic_Simulation_State<Series_Value>;
+
+/**
+ * @struct Basic_Simulation_Step
+ * @brief What happened during one time step, handed to the observer of run_simulation.
+ */
+template <typename T>
+struct Basic_Simulation_Step {
+    long timestamp;                                                  // Timestamp of the bars of this step
+    size_t hour;                                                     // Index of the step since the start of the simulation
+    const std::vector<T>& percentage_changes;                        // Price change of each ticker (NaN if it did not trade)
+    const std::vector<Ticker_Id>& buying_stocks;                     // Stocks bought this step
+    const std::vector<Ticker_Id>& selling_stocks;                    // Stocks sold this step
+    double reallocation_funds;                                       // Funds freed up by selling
+    const std::vector<std::pair<Ticker_Id, double>>& allocations;    // Amount allocated to each bought stock
+    const std::vector<double>& portfolio;                            // Portfolio at the end of the step
+    double sold;                                                     // Value of the positions sold (at the last price, before costs)
+    const std::vector<double>& filled;                               // Value added to each bought position (after costs), in the order of allocations
+};
+
+/**
+ * @brief A time step in the program's series precision (see Series_Value).
+ */
+using Simulation_Step = Basic_Simulation_Step<Series_Value>;
+
+/**
+ * @brief Value of the holdings: every position plus the cash left over by partially filled buys.
+ */
+template <typename T>
+double portfolio_value(const Basic_Simulation_State<T>& state) {
+    double value = state.execution.cash;
+    for (double position : state.portfolio) {
+        value += position;
+    }
+    return value;
+}
+
+/**
+ * @brief Adds a processed step to the state's performance metrics.
+ *
+ * A ticker's profit is its price change applied to the position it held during the step,
+ * that is after the stock manager's sells and before the portfolio manager's buys (the
+ * filled positions, so costs are not counted as price changes). The turnover is the value
+ * actually traded: leftover cash handed back by the execution simulator is not a trade.
+ *
+ * @param state The simulation state, after the step.
+ * @param step The step.
+ */
+template <typename T>
+void record_step_metrics(Basic_Simulation_State<T>& state, const Basic_Simulation_Step<T>& step) {
+    Performance_Metrics& metrics = state.metrics;
+    for (Ticker_Id stock = 0; stock < step.portfolio.size() && stock < step.percentage_changes.size(); ++stock) {
+        double percentage_change = step.percentage_changes[stock];
+        if (!std::isnan(percentage_change) && percentage_change != -100.0) {
+            metrics.add_ticker_profit(stock, step.portfolio[stock] * percentage_change / (100.0 + percentage_change));
+        }
+    }
+    double bought = 0.0;
+    for (size_t i = 0; i < step.allocations.size() && i < step.filled.size(); ++i) {
+        Ticker_Id stock = step.allocations[i].first;
+        double position_change = step.filled[i];
+        bought += position_change;
+        double percentage_change = stock < step.percentage_changes.size() ? step.percentage_changes[stock] : std::nan("");
+        if (!std::isnan(percentage_change) && percentage_change != -100.0) {
+            metrics.add_ticker_profit(stock, -position_change * percentage_change / (100.0 + percentage_change)); // Bought after the move
+        }
+    }
+    metrics.update(portfolio_value(state), step.sold + bought);
+}
+
+/**
+ * @brief Processes a new price of one ticker: its price change and volatility update.
+ *
+ * Only touches the ticker's own state (and the universe sketch in "universe" threshold mode).
+ *
+ * The price is stored in the state's series type; each change is computed in double.
+ *
+ * @param state The simulation state, updated in place.
+ * @param stock The ticker.
+ * @param close The closing price of the ticker's new bar.
+ * @return The percentage change since the ticker's last bar (NaN for its first bar).
+ */
+template <typename T>
+T advance_ticker(Basic_Simulation_State<T>& state, Ticker_Id stock, double close) {
+    const T price = static_cast<T>(close);
+    T percentage_change = std::numeric_limits<T>::quiet_NaN();
+    T old_price = state.last_price[stock];
+    if (!std::isnan(old_price) && old_price != 0) {
+        percentage_change = static_cast<T>(((static_cast<double>(price) - old_price) / old_price) * 100.0);
+    } else if (!std::isnan(old_price)) {
+        percentage_change = 0; // No change if previous price is zero
+    }
+
+    std::vector<T>& warmup = state.warmup_prices[stock];
+    if (warmup.size() < state.warmup_bars) {
+        warmup.push_back(price);
+        if (warmup.size() == state.warmup_bars) {
+            state.volatility[stock] = VolatilityFunctions::volatility_algorithm(warmup);
+        }
+    } else {
+        state.volatility[stock] = VolatilityFunctions::update_volatility(state.volatility[stock], price, old_price, state.lambda);
+        state.volatility_sum[stock] += state.volatility[stock];
+        ++state.volatility_count[stock];
+        if (state.threshold_mode == "ticker") {
+            state.volatility_sketches[stock].update(state.volatility[stock]);
+        } else if (state.threshold_mode == "universe") {
+            state.universe_sketch.update(state.volatility[stock]);
+        }
+    }
+    state.last_price[stock] = price;
+    return percentage_change;
+}
+
+/**
+ * @brief Returns the volatility thresholds of one ticker in "fixed" or "ticker" threshold mode.
+ *
+ * In "ticker" mode they are quantiles of the ticker's own volatility so far, once enough
+ * volatilities were seen; the fixed thresholds otherwise.
+ */
+template <typename T>
+Volatility_Thresholds ticker_thresholds(const Basic_Simulation_State<T>& state, Ticker_Id stock) {
+    if (state.threshold_mode == "ticker") {
+        const Quantile_Sketch& sketch = state.volatility_sketches[stock];
+        if (sketch.count() >= state.calibration_bars) {
+            return calibrate_thresholds(sketch, state.threshold_quantiles);
+        }
+    }
+    return Volatility_Thresholds();
+}
+
+/**
+ * @brief Runs the simulation over every bar newer than the state's last processed timestamp.
+ *
+ * Bars of all tickers are merged by timestamp; every distinct timestamp is one time step.
+ * In each step the tickers that traded update their volatility (seeded from their first
+ * prices, then by EWMA), the stock manager sells positions that are too volatile, and the
+ * portfolio manager applies the price changes and allocates the freed-up funds. With "ticker"
+ * or "universe" thresholds, the stock manager compares each volatility with quantiles of the
+ * volatilities seen so far, kept in streaming sketches, instead of the fixed constants. Unless the
+ * execution mode is "instant", orders are filled by the state's Execution_Simulator.
+ * Every step is also added to the state's Performance_Metrics.
+ * Because the state only depends on bars that were already processed, a run that resumes
+ * from a saved state gives the same results as a single run over all the bars.
+ *
+ * @param state The simulation state, updated in place.
+ * @param bars The bars of each ticker in timestamp order, indexed by Ticker_Id. The ranges
+ *             are views, so a sub-range of loaded data (see Time_Index) is simulated without copying it.
+ * @param on_step Optional observer, called after every step.
+ * @param ledger Optional trade ledger every sell and allocation is appended to.
+ * @return The number of steps processed.
+ */
+template <typename T>
+size_t run_simulation(Basic_Simulation_State<T>& state,
+                      const std::vector<Bar_Range>& bars,
+                      const std::type_identity_t<std::function<void(const Basic_Simulation_Step<T>&)>>& on_step = nullptr,
+                      Trade_Ledger* ledger = nullptr) {
+    const size_t n = state.portfolio.size();
+    const T nan = std::numeric_limits<T>::quiet_NaN();
+
+    // Skip the bars that were processed before, by binary search on their timestamps
+    std::vector<size_t> cursor(n, 0);
+    for (Ticker_Id stock = 0; stock < n && stock < bars.size(); ++stock) {
+        auto first_new = std::upper_bound(bars[stock].begin(), bars[stock].end(), state.last_timestamp,
+                                          [](long timestamp, const Ohlcv_Bar& bar) { return timestamp < bar.timestamp; });
+        cursor[stock] = first_new - bars[stock].begin();
+    }
+
+    std::vector<T> percentage_changes(n);
+    std::vector<T> volatilities(n);
+    std::vector<T> avg_volatilities(n);
+    std::vector<Ticker_Id> buying_stocks;
+    std::vector<Ticker_Id> selling_stocks;
+    std::vector<double> filled;
+    std::vector<Volatility_Thresholds> thresholds(n);
+    std::vector<std::uint64_t> calibrated_counts(n, 0); // Sketch counts the thresholds were computed at
+    std::uint64_t universe_calibrated_count = 0;
+    const bool calibrated = state.threshold_mode == "ticker" || state.threshold_mode == "universe";
+    size_t steps = 0;
+    state.metrics.start(portfolio_value(state));
+
+    while (true) {
+        // Next timestamp across all tickers
+        long timestamp = std::numeric_limits<long>::max();
+        for (Ticker_Id stock = 0; stock < n && stock < bars.size(); ++stock) {
+            if (cursor[stock] < bars[stock].size()) {
+                timestamp = std::min(timestamp, bars[stock][cursor[stock]].timestamp);
+            }
+        }
+        if (timestamp == std::numeric_limits<long>::max()) {
+            break;
+        }
+
+        // Price changes and volatility updates of the tickers that traded
+        state.execution.start_step();
+        for (Ticker_Id stock = 0; stock < n; ++stock) {
+            percentage_changes[stock] = nan;
+            if (stock >= bars.size() || cursor[stock] >= bars[stock].size() || bars[stock][cursor[stock]].timestamp != timestamp) {
+                continue;
+            }
+            const Ohlcv_Bar& bar = bars[stock][cursor[stock]];
+            ++cursor[stock];
+
+            percentage_changes[stock] = advance_ticker(state, stock, bar.close);
+            state.execution.observe(stock, bar.close, bar.volume, state.volatility_count[stock] > 0 ? state.volatility[stock] : 0.0);
+        }
+
+        // Tickers without an EWMA volatility yet are left out of the decisions
+        for (Ticker_Id stock = 0; stock < n; ++stock) {
+            bool ready = state.volatility_count[stock] > 0;
+            volatilities[stock] = ready ? state.volatility[stock] : nan;
+            avg_volatilities[stock] = ready ? static_cast<T>(state.volatility_sum[stock] / state.volatility_count[stock]) : nan;
+        }
+
+        // Thresholds from the volatilities seen so far; the fixed ones until there are enough.
+        // They are only recomputed from sketches that received new volatilities this step.
+        if (state.threshold_mode == "universe") {
+            if (state.universe_sketch.count() != universe_calibrated_count) {
+                Volatility_Thresholds universe_thresholds;
+                if (state.universe_sketch.count() >= state.calibration_bars) {
+                    universe_thresholds = calibrate_thresholds(state.universe_sketch, state.threshold_quantiles);
+                }
+                std::fill(thresholds.begin(), thresholds.end(), universe_thresholds);
+                universe_calibrated_count = state.universe_sketch.count();
+            }
+        } else if (state.threshold_mode == "ticker") {
+            for (Ticker_Id stock = 0; stock < n; ++stock) {
+                std::uint64_t count = state.volatility_sketches[stock].count();
+                if (count != calibrated_counts[stock]) {
+                    thresholds[stock] = ticker_thresholds(state, stock);
+                    calibrated_counts[stock] = count;
+                }
+            }
+        }
+
+        Execution_Simulator* execution = state.execution.mode == "instant" ? nullptr : &state.execution;
+        if (ledger) {
+            ledger->begin_step(timestamp, state.portfolio, state.last_price, percentage_changes);
+        }
+        double sold = 0.0;
+        double reallocation_funds = stock_manager_hour<T>(volatilities, state.portfolio, state.strategy, buying_stocks, selling_stocks,
+                                                          execution, calibrated ? &thresholds : nullptr, ledger, &sold);
+        reallocation_funds += state.execution.withdraw_cash(); // Left over by partially filled buys
+        std::vector<std::pair<Ticker_Id, double>> allocations = portfolio_manager_hour<T>(
+            buying_stocks, reallocation_funds, state.portfolio, state.strategy, avg_volatilities, percentage_changes, state.manager,
+            execution, ledger, &filled);
+
+        Basic_Simulation_Step<T> step{timestamp, state.hours_processed, percentage_changes, buying_stocks,
+                                      selling_stocks, reallocation_funds, allocations, state.portfolio, sold, filled};
+        record_step_metrics(state, step);
+        if (on_step) {
+            on_step(step);
+        }
+
+        state.last_timestamp = timestamp;
+        ++state.hours_processed;
+        ++steps;
+    }
+
+    if (ledger) {
+        ledger->flush();
+    }
+    return steps;
+}
+
+/**
+ * @brief Runs the simulation over every loaded bar newer than the state's last processed timestamp.
+ *
+ * @param state The simulation state, updated in place.
+ * @param bars The bars of each ticker in timestamp order, indexed by Ticker_Id.
+ * @param on_step Optional observer, called after every step.
+ * @param ledger Optional trade ledger every sell and allocation is appended to.
+ * @return The number of steps processed.
+ */
+template <typename T>
+size_t run_simulation(Basic_Simulation_State<T>& state,
+                      const std::vector<std::vector<Ohlcv_Bar>>& bars,
+                      const std::type_identity_t<std::function<void(const Basic_Simulation_Step<T>&)>>& on_step = nullptr,
+                      Trade_Ledger* ledger = nullptr) {
+    return run_simulation(state, std::vector<Bar_Range>(bars.begin(), bars.end()), on_step, ledger);
+}
@@ -1,46 +1,96 @@
 #pragma once
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <ranges>
+#include <span>
 #include <string>
 #include <vector>
 #include <utility> // For std::pair
+#include "symbol_table.h"
+#include "execution.h"
+#include "quantile_sketch.h"
+#include "ledger.h"
 
 /**
- * @brief Calculates the percentage changes in stock prices.
+ * @brief Calculates the percentage changes of a single ticker's prices into a caller-provided buffer.
  * 
- * This function computes the percentage change between consecutive prices for each stock.
+ * The series can be double or float (see Series_Value); each change is computed in double.
  * 
- * @param ticker_to_prices A map of stock tickers to their price vectors over time.
- * @return A map of stock tickers to their percentage change vectors.
+ * @param prices A read-only view of the ticker's prices over time.
+ * @param percentage_changes Receives the changes; must hold at least prices.size() - 1 values.
+ * @return The number of changes written.
  */
-std::map<std::string, std::vector<double>> calculate_percentage_changes(
-    const std::map<std::string, std::vector<double>>& ticker_to_prices) {
-    
-    // Map to store percentage changes for each ticker
-    std::map<std::string, std::vector<double>> ticker_to_percentage_changes;
-
-    // Iterate through each ticker and its price vector
-    for (const auto& [ticker, prices] : ticker_to_prices) {
-        std::vector<double> percentage_changes;
+template <typename T>
+size_t percentage_change_series(Series_View<T> prices, std::span<T> percentage_changes) {
+    size_t count = prices.size() > 1 ? prices.size() - 1 : 0;
 
-        // Calculate percentage changes for this ticker
-        for (size_t i = 1; i < prices.size(); ++i) {
-            double prev_price = prices[i - 1];
-            double curr_price = prices[i];
+    for (size_t i = 1; i < prices.size(); ++i) {
+        double prev_price = prices[i - 1];
+        double curr_price = prices[i];
 
-            if (prev_price != 0) { // Avoid division by zero
-                double percentage_change = ((curr_price - prev_price) / prev_price) * 100.0;
-                percentage_changes.push_back(percentage_change);
-            } else {
-                percentage_changes.push_back(0.0); // No change if previous price is zero
-            }
+        if (prev_price != 0) { // Avoid division by zero
+            double percentage_change = ((curr_price - prev_price) / prev_price) * 100.0;
+            percentage_changes[i - 1] = static_cast<T>(percentage_change);
+        } else {
+            percentage_changes[i - 1] = 0.0; // No change if previous price is zero
         }
-        
+    }
+
+    return count;
+}
+
+/**
+ * @brief Calculates the percentage changes of a single ticker's prices.
+ * 
+ * @param prices The prices of the ticker over time (a std::vector, span or any contiguous container).
+ * @return The percentage change between each pair of consecutive prices.
+ */
+template <std::ranges::contiguous_range Values>
+std::vector<std::ranges::range_value_t<Values>> percentage_change_series(const Values& prices) {
+    using T = std::ranges::range_value_t<Values>;
+    std::vector<T> percentage_changes(std::ranges::size(prices) > 1 ? std::ranges::size(prices) - 1 : 0);
+    percentage_change_series(view_of(prices), std::span<T>(percentage_changes));
+    return percentage_changes;
+}
 
-        // Add this ticker's percentage changes to the map
-        ticker_to_percentage_changes[ticker] = percentage_changes;
+/**
+ * @brief Calculates the percentage changes in stock prices into a caller-provided output.
+ * 
+ * This function computes the percentage change between consecutive prices for each stock
+ * (see percentage_change_series). The output series are resized in place, so a reused
+ * output keeps its memory between calls.
+ * 
+ * @param ticker_to_prices The price series of each ticker, indexed by Ticker_Id (a Basic_Ticker_Series or any other Ticker_Collection).
+ * @param ticker_to_percentage_changes Receives the percentage change vectors of each ticker, indexed by Ticker_Id.
+ */
+template <Ticker_Collection Series>
+void calculate_percentage_changes(const Series& ticker_to_prices, Basic_Ticker_Series<Ticker_Value<Series>>& ticker_to_percentage_changes) {
+    using T = Ticker_Value<Series>;
+    ticker_to_percentage_changes.resize(ticker_to_prices.size());
+
+    // Iterate through each ticker and its price series
+    for (Ticker_Id ticker = 0; ticker < ticker_to_prices.size(); ++ticker) {
+        Series_View<T> prices = view_of(ticker_to_prices[ticker]);
+        std::vector<T>& percentage_changes = ticker_to_percentage_changes[ticker];
+        percentage_changes.resize(prices.size() > 1 ? prices.size() - 1 : 0);
+        percentage_change_series(prices, std::span<T>(percentage_changes));
     }
+}
 
+/**
+ * @brief Calculates the percentage changes in stock prices.
+ * 
+ * @param ticker_to_prices The price series of each ticker, indexed by Ticker_Id.
+ * @return The percentage change vectors of each ticker, indexed by Ticker_Id.
+ */
+template <Ticker_Collection Series>
+Basic_Ticker_Series<Ticker_Value<Series>> calculate_percentage_changes(const Series& ticker_to_prices) {
+    
+    // Percentage changes for each ticker
+    Basic_Ticker_Series<Ticker_Value<Series>> ticker_to_percentage_changes;
+    calculate_percentage_changes(ticker_to_prices, ticker_to_percentage_changes);
     return ticker_to_percentage_changes;
 }
 
@@ -51,100 +101,278 @@ std::map<std::string, std::vector<double>> calculate_percentage_changes(
  * Contains lists of stocks to buy or sell and reallocation funds available at each hour.
  */
 struct Stock_Manager_Result {
-    std::vector<std::vector<std::string>> buying_stocks;   // List of stocks to buy at each hour
-    std::vector<std::vector<std::string>> selling_stocks;  // List of stocks to sell at each hour
+    std::vector<std::vector<Ticker_Id>> buying_stocks;     // List of stocks to buy at each hour
+    std::vector<std::vector<Ticker_Id>> selling_stocks;    // List of stocks to sell at each hour
     std::vector<double> reallocation_funds;                // Funds freed up at each hour
 };
 
+/**
+ * @struct Volatility_Thresholds
+ * @brief The volatility levels at which the strategies change their decisions.
+ *
+ * The defaults are the fixed hourly volatilities the strategies were tuned with.
+ * calibrate_thresholds can instead derive them from Quantile_Ranks for any ticker or market.
+ */
+struct Volatility_Thresholds {
+    double strong_buy = 0.0025;     // Optimistic: strong buy at or below
+    double buy = 0.003;             // Neutral: moderate buy above, slight buy at or below
+    double moderate_sell = 0.0035;  // Conservative: moderate sell above
+    double sell = 0.004;            // Every strategy sells above
+};
+
+/**
+ * @struct Quantile_Ranks
+ * @brief The rank (between 0 and 1) of past volatility at which each threshold is set.
+ *
+ * Each field matches the Volatility_Thresholds field it calibrates.
+ */
+struct Quantile_Ranks {
+    double strong_buy = 0.25;       // Strong buy at or below the 25th percentile
+    double buy = 0.5;               // Slight buy at or below the median
+    double moderate_sell = 0.75;    // Moderate sell above the 75th percentile
+    double sell = 0.9;              // Sell above the 90th percentile
+};
+
+/**
+ * @brief Turns quantile ranks into volatility thresholds from a sketch of past volatilities.
+ *
+ * @param sketch The volatilities seen so far (of one ticker, or of the whole universe).
+ * @param ranks The rank of each threshold (e.g., sell above the 90th percentile).
+ * @return The volatility at each rank.
+ */
+Volatility_Thresholds calibrate_thresholds(const Quantile_Sketch& sketch, const Quantile_Ranks& ranks) {
+    std::vector<double> values = sketch.quantiles({ranks.strong_buy, ranks.buy, ranks.moderate_sell, ranks.sell});
+    return Volatility_Thresholds{values[0], values[1], values[2], values[3]};
+}
+
+/**
+ * @struct Stock_Decision
+ * @brief What the stock manager decided for one ticker in one hour.
+ *
+ * The decision only depends on the ticker's own volatility, so it can be made wherever
+ * that ticker is simulated; applying it needs the portfolio.
+ */
+struct Stock_Decision {
+    bool buy = false;            // The stock is on the buying list
+    bool sell = false;           // Part of the position is sold
+    double sell_fraction = 0.0;  // Fraction of the position sold
+};
+
+/**
+ * @brief Applies the strategy's volatility thresholds to one ticker.
+ *
+ * @param avg_volatility The ticker's current volatility.
+ * @param strategy The investment strategy ("optimistic", "neutral", or "conservative").
+ * @param limits The volatility thresholds of the ticker.
+ * @return Whether to buy the stock or sell part of it (neither for an unknown strategy).
+ */
+Stock_Decision stock_decision(double avg_volatility, const std::string& strategy, const Volatility_Thresholds& limits) {
+    Stock_Decision decision;
+
+    // Adjustments based on the strategy and average volatility
+    if (strategy == "optimistic") {
+        // "Optimistic" strategy focuses on more buying opportunities, even at higher volatility.
+        if (avg_volatility <= limits.strong_buy) {
+            decision.buy = true; // Strong buy
+        } else if (avg_volatility <= limits.sell) {
+            decision.buy = true; // Moderate buy
+        } else {
+            // Very high volatility; sell a portion of the stock to free up funds
+            decision.sell = true;
+            decision.sell_fraction = 0.05; // Light sell
+        }
+    } else if (strategy == "neutral") {
+        // "Neutral" strategy balances between buying and selling.
+        if (avg_volatility > limits.sell) {
+            decision.sell = true;
+            decision.sell_fraction = 0.03; // Light sell for higher volatility
+        } else if (avg_volatility > limits.buy) {
+            // Moderate volatility; no action or slight buy
+            decision.buy = true;
+        } else {
+            // Low volatility; slight buy
+            decision.buy = true;
+        }
+    } else if (strategy == "conservative") {
+        // "Conservative" strategy is cautious about high volatility.
+        if (avg_volatility > limits.sell) {
+            decision.sell = true;
+            decision.sell_fraction = 0.1; // Strong sell for very high volatility
+        } else if (avg_volatility > limits.moderate_sell) {
+            decision.sell = true;
+            decision.sell_fraction = 0.05; // Moderate sell
+        } else {
+            // Low volatility; slight buy
+            decision.buy = true;
+        }
+    }
+
+    return decision;
+}
+
+/**
+ * @brief Applies one ticker's decision to the portfolio.
+ *
+ * @param stock The ticker.
+ * @param decision The decision (see stock_decision).
+ * @param my_portfolio A reference to the current portfolio, holding the invested amount of each ticker by Ticker_Id.
+ * @param buying_stocks Receives the stock if it is bought.
+ * @param selling_stocks Receives the stock if it is sold.
+ * @param reallocation_funds Receives the funds freed up by the sale.
+ * @param execution Optional execution simulator the sale is routed through; without one it fills at no cost.
+ * @param ledger Optional trade ledger the sale is recorded in.
+ * @param sold_value Optional; the value sold (at the last price, before costs) is added to it.
+ */
+void apply_stock_decision(
+    Ticker_Id stock,
+    const Stock_Decision& decision,
+    std::vector<double>& my_portfolio,
+    std::vector<Ticker_Id>& buying_stocks,
+    std::vector<Ticker_Id>& selling_stocks,
+    double& reallocation_funds,
+    Execution_Simulator* execution = nullptr,
+    Trade_Ledger* ledger = nullptr,
+    double* sold_value = nullptr) {
+
+    if (decision.buy) {
+        buying_stocks.push_back(stock);
+    }
+    if (!decision.sell) {
+        return;
+    }
+
+    double& invested_money = my_portfolio[stock];
+    double adjustment = -invested_money * decision.sell_fraction;
+    reallocation_funds -= adjustment; // Add funds
+    selling_stocks.push_back(stock);
+
+    // Route the sale through the execution simulator: costs reduce the freed-up funds
+    if (execution && adjustment < 0.0) {
+        Execution_Fill fill = execution->sell(stock, -adjustment);
+        reallocation_funds += adjustment + fill.cash_change;
+        adjustment = fill.position_change;
+    }
+
+    // Update the portfolio based on adjustment
+    invested_money += adjustment;
+    if (ledger && adjustment < 0.0) {
+        ledger->append(Ledger_Type::Sell, stock, -adjustment, invested_money);
+    }
+    if (sold_value && adjustment < 0.0) {
+        *sold_value -= adjustment;
+    }
+}
+
+/**
+ * @brief Makes the buying and selling decisions of a single hour.
+ * 
+ * This function applies the strategy's volatility thresholds to every ticker (see stock_decision),
+ * sells part of the positions with too much volatility, and lists the stocks to buy.
+ * 
+ * @param volatilities A read-only view of the current volatility of each ticker, indexed by Ticker_Id (NaN for tickers without data).
+ * @param my_portfolio A reference to the current portfolio, holding the invested amount of each ticker by Ticker_Id.
+ * @param strategy The investment strategy ("optimistic", "neutral", or "conservative").
+ * @param buying_stocks Receives the stocks to buy this hour.
+ * @param selling_stocks Receives the stocks sold this hour.
+ * @param execution Optional execution simulator the sales are routed through; without one they fill at no cost.
+ * @param thresholds Optional volatility thresholds of each ticker (e.g., from calibrate_thresholds); the fixed defaults without them.
+ * @param ledger Optional trade ledger the sales are recorded in.
+ * @param sold_value Optional; receives the value sold this hour (at the last price, before costs).
+ * @return The funds freed up by selling this hour.
+ */
+template <typename T>
+double stock_manager_hour(
+    Series_View<T> volatilities,
+    std::vector<double>& my_portfolio,
+    const std::string& strategy,
+    std::vector<Ticker_Id>& buying_stocks,
+    std::vector<Ticker_Id>& selling_stocks,
+    Execution_Simulator* execution = nullptr,
+    const std::vector<Volatility_Thresholds>* thresholds = nullptr,
+    Trade_Ledger* ledger = nullptr,
+    double* sold_value = nullptr) {
+
+    const Volatility_Thresholds fixed_thresholds;
+    buying_stocks.clear();
+    selling_stocks.clear();
+    double reallocation_funds = 0.0;
+    if (sold_value) {
+        *sold_value = 0.0;
+    }
+
+    // Tickers missing from the portfolio start with nothing invested
+    if (my_portfolio.size() < volatilities.size()) {
+        my_portfolio.resize(volatilities.size(), 0.0);
+    }
+
+    for (Ticker_Id stock = 0; stock < volatilities.size(); ++stock) {
+        double avg_volatility = volatilities[stock];
+        if (std::isnan(avg_volatility)) {
+            continue; // No volatility data for this ticker
+        }
+        const Volatility_Thresholds& limits = thresholds ? (*thresholds)[stock] : fixed_thresholds;
+        Stock_Decision decision = stock_decision(avg_volatility, strategy, limits);
+        apply_stock_decision(stock, decision, my_portfolio, buying_stocks, selling_stocks, reallocation_funds, execution, ledger, sold_value);
+    }
+
+    return reallocation_funds;
+}
+
 /**
  * @brief Manages stock buying and selling decisions based on strategy and volatility data.
  * 
  * This function determines which stocks to buy or sell and calculates the funds 
  * available for reallocation based on a chosen investment strategy and stock volatility.
  * 
- * @param stocks A map of stock tickers to their volatility vectors over time.
- * @param my_portfolio A reference to the current portfolio, mapping stock tickers to invested amounts.
+ * @param stocks The volatility series over time of each ticker, indexed by Ticker_Id (a Basic_Ticker_Series or any other Ticker_Collection).
+ * @param my_portfolio A reference to the current portfolio, holding the invested amount of each ticker by Ticker_Id.
  * @param strategy The investment strategy ("optimistic", "neutral", or "conservative").
  * @return A Stock_Manager_Result object containing the buying, selling decisions, and reallocation funds.
  */
+template <Ticker_Collection Series>
 Stock_Manager_Result stock_manager(
-    const std::map<std::string, std::vector<double>>& stocks,
-    std::map<std::string, double>& my_portfolio,
+    const Series& stocks,
+    std::vector<double>& my_portfolio,
     const std::string& strategy) {
+    using T = Ticker_Value<Series>;
     
     Stock_Manager_Result result;
 
+    // Tickers missing from the portfolio start with nothing invested
+    if (my_portfolio.size() < stocks.size()) {
+        my_portfolio.resize(stocks.size(), 0.0);
+    }
+
     // Determine the maximum number of hours based on any stock's volatility vector
     size_t max_hours = 0;
-    for (const auto& [stock, volatility_values] : stocks) {
-        max_hours = std::max(max_hours, volatility_values.size());
+    for (const auto& volatility_values : stocks) {
+        max_hours = std::max(max_hours, static_cast<size_t>(std::ranges::size(volatility_values)));
     }
 
     // Process each hour
+    std::vector<T> hour_volatilities(stocks.size());
     for (size_t hour = 0; hour < max_hours; ++hour) {
-        std::vector<std::string> buying_stocks_hour;
-        std::vector<std::string> selling_stocks_hour;
-        double reallocation_funds_hour = 0.0;
-
-        for (const auto& [stock, volatility_values] : stocks) {
-            double& invested_money = my_portfolio[stock];
-            double adjustment = 0.0;
-
-            // Get the volatility for the current hour, defaulting to the last value if out of bounds
-            double avg_volatility = hour < volatility_values.size() ? volatility_values[hour] : volatility_values.back();
-
-                // Adjustments based on the strategy and average volatility
-                if (strategy == "optimistic") {
-                    // "Optimistic" strategy focuses on more buying opportunities, even at higher volatility.
-                    if (avg_volatility <= 0.0025) {
-                        buying_stocks_hour.push_back(stock); // Strong buy
-                    } else if (avg_volatility <= 0.004) {
-                        buying_stocks_hour.push_back(stock); // Moderate buy
-                    } else {
-                        // Very high volatility; sell a portion of the stock to free up funds
-                        adjustment = -invested_money * 0.05; // Light sell
-                        reallocation_funds_hour -= adjustment; // Add funds
-                        selling_stocks_hour.push_back(stock);
-                    }
-                } else if (strategy == "neutral") {
-                    // "Neutral" strategy balances between buying and selling.
-                    if (avg_volatility > 0.004) {
-                        adjustment = -invested_money * 0.03; // Light sell for higher volatility
-                        reallocation_funds_hour -= adjustment; // Free up funds
-                        selling_stocks_hour.push_back(stock);
-                    } else if (avg_volatility > 0.003) {
-                        // Moderate volatility; no action or slight buy
-                        buying_stocks_hour.push_back(stock);
-                    } else {
-                        // Low volatility; slight buy
-                        buying_stocks_hour.push_back(stock);
-                    }
-                } else if (strategy == "conservative") {
-                    // "Conservative" strategy is cautious about high volatility.
-                    if (avg_volatility > 0.004) {
-                        adjustment = -invested_money * 0.1; // Strong sell for very high volatility
-                        reallocation_funds_hour -= adjustment; // Free up significant funds
-                        selling_stocks_hour.push_back(stock);
-                    } else if (avg_volatility > 0.0035) {
-                        adjustment = -invested_money * 0.05; // Moderate sell
-                        reallocation_funds_hour -= adjustment;
-                        selling_stocks_hour.push_back(stock);
-                    } else {
-                        // Low volatility; slight buy
-                        buying_stocks_hour.push_back(stock);
-                    }
-                }
-                
-
-            // Update the portfolio based on adjustment
-            invested_money += adjustment;
+        std::vector<Ticker_Id> buying_stocks_hour;
+        std::vector<Ticker_Id> selling_stocks_hour;
+
+        // Get the volatility for the current hour, defaulting to the last value if out of bounds
+        for (Ticker_Id stock = 0; stock < stocks.size(); ++stock) {
+            Series_View<T> volatility_values = view_of(stocks[stock]);
+            if (volatility_values.empty()) {
+                hour_volatilities[stock] = std::numeric_limits<T>::quiet_NaN();
+            } else {
+                hour_volatilities[stock] = hour < volatility_values.size() ? volatility_values[hour] : volatility_values.back();
+            }
         }
 
+        double reallocation_funds_hour = stock_manager_hour<T>(
+            hour_volatilities, my_portfolio, strategy, buying_stocks_hour, selling_stocks_hour);
+
         // Save results for this hour
-        result.buying_stocks.push_back(buying_stocks_hour);
-        result.selling_stocks.push_back(selling_stocks_hour);
+        result.buying_stocks.push_back(std::move(buying_stocks_hour));
+        result.selling_stocks.push_back(std::move(selling_stocks_hour));
         result.reallocation_funds.push_back(reallocation_funds_hour);
     }
 
     return result;
-}
\ No newline at end of file
+}
@@ -0,0 +1,187 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility> // For std::move
+#include <vector>
+
+/**
+ * @brief Dense integer identifier of an interned ticker symbol.
+ *
+ * IDs are handed out in interning order starting at 0, so they can be used
+ * directly as indices into flat per-ticker arrays.
+ */
+using Ticker_Id = std::uint32_t;
+
+/**
+ * @brief Per-ticker series of any value type stored as a flat array indexed by Ticker_Id.
+ */
+template <typename T>
+using Basic_Ticker_Series = std::vector<std::vector<T>>;
+
+/**
+ * @brief Per-ticker series stored as a flat array indexed by Ticker_Id.
+ */
+using Ticker_Series = Basic_Ticker_Series<double>;
+
+/**
+ * @brief Per-ticker series in single precision, half the memory of a Ticker_Series.
+ */
+using Float_Ticker_Series = Basic_Ticker_Series<float>;
+
+/**
+ * @brief Value type of the price, return and volatility series of the program.
+ *
+ * Configuring with -DENABLE_FLOAT32_SERIES=ON stores them as float, which halves their
+ * memory footprint and doubles the SIMD width of the kernels over them. The simulation
+ * state (see Simulation_State) uses it too; money and sums are still kept in double.
+ */
+#ifdef STOCK_FLOAT32_SERIES
+using Series_Value = float;
+#else
+using Series_Value = double;
+#endif
+
+/**
+ * @brief Read-only view of one series (prices, returns or volatilities), without copying it.
+ *
+ * A std::vector converts to it implicitly, and so can pooled buffers or memory-mapped arrays.
+ */
+template <typename T>
+using Series_View = std::span<const T>;
+
+/**
+ * @brief Read-only view of per-ticker series indexed by Ticker_Id, e.g. over memory-mapped data.
+ */
+template <typename T>
+using Ticker_Series_View = std::span<const Series_View<T>>;
+
+/**
+ * @brief Any per-ticker collection of contiguous series indexed by Ticker_Id:
+ * a Basic_Ticker_Series, a Ticker_Series_View or a std::vector of spans.
+ */
+template <typename Series>
+concept Ticker_Collection = std::ranges::random_access_range<const Series> &&
+                            std::ranges::sized_range<const Series> &&
+                            std::ranges::contiguous_range<std::ranges::range_reference_t<const Series>>;
+
+/**
+ * @brief Value type of the series of a Ticker_Collection (e.g., double for a Ticker_Series).
+ */
+template <typename Series>
+using Ticker_Value = std::remove_cv_t<std::ranges::range_value_t<std::ranges::range_reference_t<const Series>>>;
+
+/**
+ * @brief Views a contiguous container (e.g., a std::vector or a span) as a Series_View.
+ */
+template <std::ranges::contiguous_range Values>
+Series_View<std::ranges::range_value_t<Values>> view_of(const Values& values) {
+    return Series_View<std::ranges::range_value_t<Values>>(std::ranges::data(values), std::ranges::size(values));
+}
+
+/**
+ * @struct Symbol_Table
+ * @brief Interns ticker symbols into dense Ticker_Id values.
+ *
+ * Tickers are interned once when data is ingested. Everything downstream works
+ * on IDs and the strings are only looked up again when printing or plotting.
+ */
+struct Symbol_Table {
+    /**
+     * @brief Returns the ID of a ticker, assigning the next free ID if it is new.
+     *
+     * @param ticker The stock ticker symbol (e.g., "AAPL").
+     * @return The dense ID of the ticker.
+     */
+    Ticker_Id intern(const std::string& ticker) {
+        auto it = ids.find(ticker);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        Ticker_Id id = static_cast<Ticker_Id>(names.size());
+        ids.emplace(ticker, id);
+        names.push_back(ticker);
+        return id;
+    }
+
+    /**
+     * @brief Looks up the ID of an already interned ticker.
+     *
+     * @param ticker The stock ticker symbol.
+     * @return The dense ID of the ticker.
+     * @throws std::out_of_range If the ticker has not been interned.
+     */
+    Ticker_Id id(const std::string& ticker) const {
+        auto it = ids.find(ticker);
+        if (it == ids.end()) {
+            throw std::out_of_range("Unknown ticker: " + ticker);
+        }
+        return it->second;
+    }
+
+    /**
+     * @brief Checks whether a ticker has been interned.
+     */
+    bool contains(const std::string& ticker) const {
+        return ids.count(ticker) > 0;
+    }
+
+    /**
+     * @brief Returns the ticker symbol of an ID.
+     */
+    const std::string& name(Ticker_Id id) const {
+        return names.at(id);
+    }
+
+    /**
+     * @brief Number of interned tickers.
+     */
+    size_t size() const {
+        return names.size();
+    }
+
+    std::unordered_map<std::string, Ticker_Id> ids;  // Ticker symbol to ID
+    std::vector<std::string> names;                  // ID to ticker symbol
+};
+
+/**
+ * @brief Converts a per-ticker series to another value type (e.g., double to float).
+ *
+ * @param series The series to convert, indexed by Ticker_Id.
+ * @return The converted series, indexed by Ticker_Id.
+ */
+template <typename T, typename U>
+Basic_Ticker_Series<T> convert_ticker_series(const Basic_Ticker_Series<U>& series) {
+    Basic_Ticker_Series<T> result(series.size());
+    for (size_t ticker = 0; ticker < series.size(); ++ticker) {
+        result[ticker].assign(series[ticker].begin(), series[ticker].end());
+    }
+    return result;
+}
+
+/**
+ * @brief Converts a ticker-keyed map of series into a flat array indexed by Ticker_Id.
+ *
+ * Unknown tickers are interned on the fly. Tickers without data keep an empty series.
+ *
+ * @param by_ticker A map of stock tickers to their series; the vectors are moved out of it.
+ * @param symbols The symbol table used to assign IDs.
+ * @return The series indexed by Ticker_Id (a Ticker_Series for prices).
+ */
+template <typename T>
+std::vector<std::vector<T>> to_ticker_series(std::map<std::string, std::vector<T>> by_ticker, Symbol_Table& symbols) {
+    for (const auto& [ticker, series] : by_ticker) {
+        symbols.intern(ticker);
+    }
+
+    std::vector<std::vector<T>> result(symbols.size());
+    for (auto& [ticker, series] : by_ticker) {
+        result[symbols.id(ticker)] = std::move(series);
+    }
+    return result;
+}
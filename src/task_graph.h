@@ -0,0 +1,139 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility> // For std::move
+#include <vector>
+
+/**
+ * @struct Task_Graph
+ * @brief Runs tasks on a pool of threads as soon as the tasks they depend on have finished.
+ *
+ * Dependencies can only point to tasks added earlier, so the graph is always acyclic.
+ * A task becomes ready when its last dependency finishes and goes to the front of the
+ * ready queue, ahead of the roots not started yet, so the next free thread continues a
+ * chain already in flight (e.g., parses a finished download) before starting a new one.
+ * Independent chains (fetch -> parse -> derive for each ticker) therefore overlap instead
+ * of running in phases. A task that depends on many others acts as a barrier.
+ */
+struct Task_Graph {
+    using Task_Id = size_t;
+
+    /**
+     * @brief Adds a task.
+     *
+     * @param work The work of the task.
+     * @param dependencies The tasks that must finish before this one starts.
+     * @return The ID of the task, used to depend on it.
+     * @throws std::invalid_argument If a dependency has not been added yet.
+     */
+    Task_Id add_task(std::function<void()> work, const std::vector<Task_Id>& dependencies = {}) {
+        Task_Id id = tasks.size();
+        for (Task_Id dependency : dependencies) {
+            if (dependency >= id) {
+                throw std::invalid_argument("Task_Graph::add_task: dependencies must be added before their dependents");
+            }
+        }
+        tasks.push_back(Task{std::move(work), {}, dependencies.size()});
+        for (Task_Id dependency : dependencies) {
+            tasks[dependency].dependents.push_back(id);
+        }
+        return id;
+    }
+
+    /**
+     * @brief Runs every task and waits for them to finish.
+     *
+     * If a task throws, no further tasks are started and the first exception is rethrown
+     * once the running tasks have finished.
+     *
+     * @param n_threads The number of threads (0 for one per core). Use more threads than
+     *                  cores when tasks block on I/O, such as downloads.
+     */
+    void run(size_t n_threads = 0) {
+        if (n_threads == 0) {
+            n_threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        n_threads = std::min(n_threads, tasks.size());
+
+        std::vector<size_t> remaining(tasks.size());
+        std::deque<Task_Id> ready;
+        for (Task_Id id = 0; id < tasks.size(); ++id) {
+            remaining[id] = tasks[id].n_dependencies;
+            if (remaining[id] == 0) {
+                ready.push_back(id);
+            }
+        }
+
+        std::mutex mutex;
+        std::condition_variable task_ready;
+        size_t finished = 0;
+        std::exception_ptr error;
+
+        auto worker = [&]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                task_ready.wait(lock, [&]() { return !ready.empty() || finished == tasks.size() || error; });
+                if (error || finished == tasks.size()) {
+                    return;
+                }
+                Task_Id id = ready.front();
+                ready.pop_front();
+
+                lock.unlock();
+                std::exception_ptr task_error;
+                try {
+                    tasks[id].work();
+                } catch (...) {
+                    task_error = std::current_exception();
+                }
+                lock.lock();
+
+                ++finished;
+                if (task_error && !error) {
+                    error = task_error;
+                }
+                for (Task_Id dependent : tasks[id].dependents) {
+                    if (--remaining[dependent] == 0) {
+                        ready.push_front(dependent);
+                    }
+                }
+                task_ready.notify_all();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(n_threads);
+        for (size_t i = 0; i < n_threads; ++i) {
+            threads.emplace_back(worker);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    /**
+     * @brief Number of tasks in the graph.
+     */
+    size_t size() const {
+        return tasks.size();
+    }
+
+private:
+    struct Task {
+        std::function<void()> work;       // The work of the task
+        std::vector<Task_Id> dependents;  // Tasks waiting for this one
+        size_t n_dependencies;            // Number of tasks this one waits for
+    };
+
+    std::vector<Task> tasks;
+};
@@ -0,0 +1,227 @@
+#pragma once
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <utility> // For std::pair
+#include <vector>
+#include "ohlcv.h"
+
+/**
+ * @brief Converts a UTC calendar date into days since 1970-01-01.
+ *
+ * @param year The year (e.g., 2024).
+ * @param month The month (1-12).
+ * @param day The day of the month (1-31).
+ * @return The number of days since the Unix epoch (negative before it).
+ */
+long days_from_civil(long year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    const long era = (year >= 0 ? year : year - 399) / 400;
+    const unsigned year_of_era = static_cast<unsigned>(year - era * 400);
+    const unsigned day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const unsigned day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + static_cast<long>(day_of_era) - 719468;
+}
+
+/**
+ * @brief Converts days since 1970-01-01 into a UTC calendar date.
+ *
+ * @param days The number of days since the Unix epoch.
+ * @param year Receives the year.
+ * @param month Receives the month (1-12).
+ * @param day Receives the day of the month (1-31).
+ */
+void civil_from_days(long days, long& year, unsigned& month, unsigned& day) {
+    days += 719468;
+    const long era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned day_of_era = static_cast<unsigned>(days - era * 146097);
+    const unsigned year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    const unsigned day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    const unsigned shifted_month = (5 * day_of_year + 2) / 153;
+    day = day_of_year - (153 * shifted_month + 2) / 5 + 1;
+    month = shifted_month < 10 ? shifted_month + 3 : shifted_month - 9;
+    year = static_cast<long>(year_of_era) + era * 400 + (month <= 2);
+}
+
+/**
+ * @brief Moves a Unix timestamp by a number of calendar months (UTC).
+ *
+ * The time of day is kept; the day is clamped to the length of the target month
+ * (e.g., January 31st plus one month is the last day of February).
+ *
+ * @param timestamp The Unix timestamp.
+ * @param months The number of months to add (may be negative).
+ * @return The moved timestamp.
+ */
+long add_months(long timestamp, int months) {
+    long days = timestamp >= 0 ? timestamp / 86400 : (timestamp - 86399) / 86400;
+    long seconds = timestamp - days * 86400;
+    long year;
+    unsigned month;
+    unsigned day;
+    civil_from_days(days, year, month, day);
+
+    long month_index = year * 12 + (month - 1) + months;
+    year = month_index >= 0 ? month_index / 12 : (month_index - 11) / 12;
+    month = static_cast<unsigned>(month_index - year * 12) + 1;
+    static const unsigned month_days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    unsigned last_day = month_days[month - 1] + (month == 2 && leap);
+    day = std::min(day, last_day);
+
+    return days_from_civil(year, month, day) * 86400 + seconds;
+}
+
+/**
+ * @brief Returns a view of the bars of a single ticker in the window [start, end).
+ *
+ * @param bars The bars of the ticker in timestamp order.
+ * @param start The first timestamp of the window.
+ * @param end The end of the window (excluded).
+ * @return A view into the bars, found by binary search.
+ */
+Bar_Range slice_bars(const std::vector<Ohlcv_Bar>& bars, long start, long end) {
+    auto before = [](const Ohlcv_Bar& bar, long timestamp) { return bar.timestamp < timestamp; };
+    auto first = std::lower_bound(bars.begin(), bars.end(), start, before);
+    auto last = std::lower_bound(first, bars.end(), std::max(start, end), before);
+    return Bar_Range(bars.data() + (first - bars.begin()), bars.data() + (last - bars.begin()));
+}
+
+/**
+ * @struct Time_Index
+ * @brief Finds the bars of any time window in loaded per-ticker series without copying them.
+ *
+ * For every ticker the index stores the offset of the first bar of each period (a day by
+ * default), so a timestamp is located by jumping to its period and binary searching only
+ * the bars of that period. slice returns zero-copy Bar_Range views that run_simulation
+ * accepts directly, so many (overlapping) windows can be backtested on the same data.
+ * The index refers to the series it was built from; they must outlive it and stay unchanged.
+ */
+struct Time_Index {
+    /**
+     * @brief Builds the index.
+     *
+     * @param bars The bars of each ticker in timestamp order, indexed by Ticker_Id.
+     * @param period The length of the indexed periods in seconds.
+     * @throws std::invalid_argument If the period is not positive.
+     */
+    explicit Time_Index(const std::vector<std::vector<Ohlcv_Bar>>& bars, long period = 86400)
+        : bars(&bars), period(period), offsets(bars.size()) {
+        if (period <= 0) {
+            throw std::invalid_argument("Time_Index: period must be positive");
+        }
+        first_timestamp = std::numeric_limits<long>::max();
+        last_timestamp = std::numeric_limits<long>::min();
+        for (const auto& series : bars) {
+            if (!series.empty()) {
+                first_timestamp = std::min(first_timestamp, series.front().timestamp);
+                last_timestamp = std::max(last_timestamp, series.back().timestamp);
+            }
+        }
+        if (first_timestamp > last_timestamp) {
+            first_timestamp = last_timestamp = 0;
+            return;
+        }
+
+        origin = first_timestamp - ((first_timestamp % period) + period) % period;
+        n_periods = static_cast<size_t>((last_timestamp - origin) / period) + 1;
+        for (size_t stock = 0; stock < bars.size(); ++stock) {
+            const auto& series = bars[stock];
+            std::vector<size_t>& starts = offsets[stock];
+            starts.resize(n_periods + 1);
+            size_t i = 0;
+            for (size_t p = 0; p <= n_periods; ++p) {
+                long period_start = origin + static_cast<long>(p) * period;
+                while (i < series.size() && series[i].timestamp < period_start) {
+                    ++i;
+                }
+                starts[p] = i;
+            }
+            starts[n_periods] = series.size();
+        }
+    }
+
+    /**
+     * @brief Returns the index of the first bar of a ticker at or after a timestamp.
+     */
+    size_t lower_bound(size_t stock, long timestamp) const {
+        const auto& series = (*bars)[stock];
+        if (n_periods == 0 || timestamp <= origin) {
+            return 0;
+        }
+        size_t p = static_cast<size_t>((timestamp - origin) / period);
+        if (p >= n_periods) {
+            return series.size();
+        }
+        const std::vector<size_t>& starts = offsets[stock];
+        auto first = series.begin() + starts[p];
+        auto last = series.begin() + starts[p + 1];
+        auto found = std::lower_bound(first, last, timestamp, [](const Ohlcv_Bar& bar, long t) {
+            return bar.timestamp < t;
+        });
+        return static_cast<size_t>(found - series.begin());
+    }
+
+    /**
+     * @brief Returns views of the bars of every ticker in the window [start, end).
+     *
+     * @param start The first timestamp of the window.
+     * @param end The end of the window (excluded).
+     * @return One Bar_Range per ticker, indexed by Ticker_Id.
+     */
+    std::vector<Bar_Range> slice(long start, long end) const {
+        std::vector<Bar_Range> ranges(bars->size());
+        for (size_t stock = 0; stock < bars->size(); ++stock) {
+            const auto& series = (*bars)[stock];
+            size_t first = lower_bound(stock, start);
+            size_t last = std::max(first, lower_bound(stock, end));
+            ranges[stock] = Bar_Range(series.data() + first, series.data() + last);
+        }
+        return ranges;
+    }
+
+    /**
+     * @brief Returns views of the bars of every ticker during a number of calendar months.
+     *
+     * @param start The first timestamp of the window.
+     * @param months The length of the window in calendar months.
+     * @return One Bar_Range per ticker, indexed by Ticker_Id.
+     */
+    std::vector<Bar_Range> slice_months(long start, int months) const {
+        return slice(start, add_months(start, months));
+    }
+
+    const std::vector<std::vector<Ohlcv_Bar>>* bars;  // Indexed series (not owned)
+    long period;                                      // Length of the indexed periods in seconds
+    long origin = 0;                                  // Start of the first period
+    size_t n_periods = 0;                             // Number of periods covered by the data
+    long first_timestamp;                             // Earliest bar of any ticker
+    long last_timestamp;                              // Latest bar of any ticker
+    std::vector<std::vector<size_t>> offsets;         // First bar of each period, per ticker (n_periods + 1 entries)
+};
+
+/**
+ * @brief Lists rolling windows of whole calendar months, e.g. every 3-month window stepped by one month.
+ *
+ * @param start The start of the first window.
+ * @param end The end of the data; only windows ending at or before it are listed.
+ * @param window_months The length of each window in months.
+ * @param step_months The number of months between the starts of consecutive windows.
+ * @return The [start, end) timestamps of each window.
+ * @throws std::invalid_argument If the window or step is not positive.
+ */
+std::vector<std::pair<long, long>> rolling_month_windows(long start, long end, int window_months, int step_months) {
+    if (window_months <= 0 || step_months <= 0) {
+        throw std::invalid_argument("rolling_month_windows: window and step must be positive");
+    }
+    std::vector<std::pair<long, long>> windows;
+    for (int offset = 0;; offset += step_months) {
+        long window_start = add_months(start, offset);
+        long window_end = add_months(start, offset + window_months);
+        if (window_end > end) {
+            break;
+        }
+        windows.emplace_back(window_start, window_end);
+    }
+    return windows;
+}
@@ -3,69 +3,104 @@
 #include <vector>
 #include <numeric>
 #include <cmath>
+#include <cstddef>
 #include <iostream>
 #include <map>
+#include <ranges>
+#include <span>
+#include "symbol_table.h"
 
+/**
+ * The functions are templated on the value type T of the series (double or float).
+ * Sums and intermediate results are always computed in double; only the stored
+ * results are rounded to T, so float series keep their accuracy while halving memory.
+ * Series are taken as read-only views (Series_View), so vectors, pooled buffers and
+ * memory-mapped data are all passed without copying; outputs go to caller-provided buffers.
+ */
 namespace VolatilityFunctions {
 
 /**
- * @brief Calculates the average of a vector of doubles.
+ * @brief Calculates the average of a series of values.
  * 
- * @param return_list A vector containing the data points.
+ * @param return_list A read-only view of the data points.
  * @return The average value of the data points.
  */
-// Return datatype: double 
-double average(std::vector<double>& return_list) {
+// Return datatype: T (accumulated in double)
+template <typename T>
+T average(Series_View<T> return_list) {
     double average = std::accumulate(return_list.begin(), return_list.end(), 0.0) / return_list.size();
-    return average;
+    return static_cast<T>(average);
 };
 
 /**
  * @brief Computes the average return for a given time period.
  * 
- * @param r_average_list A vector of returns for the given period.
+ * @param r_average_list A read-only view of the returns for the given period.
  * @return The average return.
  */
-double average_return(std::vector<double> r_average_list) {
-    double r_bar = average(r_average_list);
+template <typename T>
+T average_return(Series_View<T> r_average_list) {
+    T r_bar = average(r_average_list);
     return r_bar;
 };
 
+/**
+ * @brief Computes the logarithmic return between two consecutive prices.
+ * 
+ * @param price A read-only view of stock prices over time.
+ * @param i The index of the first of the two prices.
+ * @return The log return \f$\ln(p_{i+1} / p_i)\f$, rounded to the series' value type.
+ */
+template <typename T>
+T log_return(Series_View<T> price, size_t i) {
+    double r_t = log(static_cast<double>(price[i + 1]) / price[i]);
+    return static_cast<T>(r_t);
+};
 
 /**
- * @brief Computes the logarithmic returns for a given price vector.
+ * @brief Computes the logarithmic returns for a given price series into a caller-provided buffer.
  * 
- * @param price A vector of stock prices over time.
- * @return A vector of logarithmic returns.
+ * @param price A read-only view of stock prices over time.
+ * @param r_t_list Receives the log returns; must hold at least price.size() - 1 values.
+ * @return The number of log returns written.
  */
-std::vector<double> logarithmic_return_function(std::vector<double>& price) {
-    std::vector<double> r_t_list;
-    
-    // Using a regular iterator to loop through all the initial prices
-    for (std::vector<double>::iterator it = price.begin(); it != price.end()-1; ++it) {
-        double r_t = log(*(it + 1) / *it);
-        r_t_list.push_back(r_t);
-    
+template <typename T>
+size_t logarithmic_returns(Series_View<T> price, std::span<T> r_t_list) {
+    size_t count = price.size() > 1 ? price.size() - 1 : 0;
+    for (size_t i = 0; i < count; ++i) {
+        r_t_list[i] = log_return(price, i);
     }
-    return r_t_list; // Assuming you want to return the average of r_t_list
+    return count;
 };
 
 /**
- * @brief Computes the variance for a given vector of log returns and average return.
+ * @brief Computes the logarithmic returns for a given price series.
  * 
- * @param log_return_for_time_period A vector of log returns for the time period.
+ * @param price A read-only view of stock prices over time.
+ * @return A vector of logarithmic returns (see logarithmic_returns to reuse a buffer).
+ */
+template <typename T>
+std::vector<T> logarithmic_return_function(Series_View<T> price) {
+    std::vector<T> r_t_list(price.size() > 1 ? price.size() - 1 : 0);
+    logarithmic_returns(price, std::span<T>(r_t_list));
+    return r_t_list;
+};
+
+/**
+ * @brief Computes the variance for a given series of log returns and average return.
+ * 
+ * @param log_return_for_time_period A read-only view of the log returns for the time period.
  * @param average_return_for_time_period The average return for the same period.
  * @return The variance of the log returns.
  */
-double iter_variance(const std::vector<double>& log_return_for_time_period, double average_return_for_time_period) {
+template <typename T>
+T iter_variance(Series_View<T> log_return_for_time_period, T average_return_for_time_period) {
         double variance_result = 0.0;
-        int count = 0;
-        for (std::vector<double>::const_iterator it = log_return_for_time_period.begin(); it != log_return_for_time_period.end(); ++it) {
-            variance_result = std::pow((*it - average_return_for_time_period), 2.0) + variance_result;
-            count++;
+        for (T value : log_return_for_time_period) {
+            variance_result = std::pow((static_cast<double>(value) - average_return_for_time_period), 2.0) + variance_result;
         };
 
-        return variance_result;
+        return static_cast<T>(variance_result);
 
 };
 
@@ -73,14 +108,15 @@ double iter_variance(const std::vector<double>& log_return_for_time_period, doub
 /**
  * @brief Calculates the volatility for a given time period.
  * 
- * @param log_return A vector of log returns for the time period.
+ * @param log_return A read-only view of the log returns for the time period.
  * @param average The average return for the time period.
  * @return The volatility (standard deviation) of the log returns.
  */
-double volatility(std::vector<double>& log_return, double average) {
-    double variance = iter_variance(log_return, average)/(log_return.size() - 1);
+template <typename T>
+T volatility(Series_View<T> log_return, T average) {
+    double variance = static_cast<double>(iter_variance(log_return, average))/(log_return.size() - 1);
     double volatility = std::sqrt(variance);
-    return volatility;
+    return static_cast<T>(volatility);
 };
 
 /**
@@ -92,29 +128,106 @@ double volatility(std::vector<double>& log_return, double average) {
  * @param lambda The smoothing parameter for EWMA.
  * @return The updated volatility.
  */
-double update_volatility(double old_volatility, double new_price, double old_price, double lambda) {
+template <typename T>
+T update_volatility(T old_volatility, T new_price, T old_price, double lambda) {
     // Calculate the log return
-    double r_t = log(new_price / old_price);
+    double r_t = log(static_cast<double>(new_price) / old_price);
     
     // Update variance using EWMA formula
-    double old_variance = std::pow(old_volatility, 2.0);
+    double old_variance = std::pow(static_cast<double>(old_volatility), 2.0);
     double new_variance = (1.0 - lambda) * std::pow(r_t, 2.0) + lambda * old_variance;
     
     // Return the updated volatility (square root of variance)
-    return std::sqrt(new_variance);
+    return static_cast<T>(std::sqrt(new_variance));
+};
+
+/**
+ * @brief Computes the Parkinson variance estimate of a single bar from its high-low range.
+ * 
+ * @param high The highest price of the bar.
+ * @param low The lowest price of the bar.
+ * @return The variance estimate \f$\ln(H/L)^2 / (4\ln 2)\f$.
+ */
+double parkinson_variance(double high, double low) {
+    double range = log(high / low);
+    return range * range / (4.0 * log(2.0));
+};
+
+/**
+ * @brief Computes the Garman-Klass variance estimate of a single bar.
+ * 
+ * Combines the high-low range with the open-close move, which makes it more efficient
+ * than the Parkinson estimate when the open and close are known.
+ * 
+ * @param open The opening price of the bar.
+ * @param high The highest price of the bar.
+ * @param low The lowest price of the bar.
+ * @param close The closing price of the bar.
+ * @return The variance estimate \f$\frac{1}{2}\ln(H/L)^2 - (2\ln 2 - 1)\ln(C/O)^2\f$.
+ */
+double garman_klass_variance(double open, double high, double low, double close) {
+    double range = log(high / low);
+    double move = log(close / open);
+    return 0.5 * range * range - (2.0 * log(2.0) - 1.0) * move * move;
 };
 
 /**
  * @brief Calculates the volatility for a stock over a given time period using an algorithm.
  * 
- * @param stock_prices A vector of stock prices over the given period.
+ * Gives the same result as volatility(logarithmic_return_function(prices), average_return(...)),
+ * but recomputes the log returns in each pass instead of storing them, so it allocates nothing.
+ * 
+ * @param stock_prices A read-only view of the stock prices over the given period.
  * @return The calculated volatility.
  */
-double volatility_algorithm(std::vector<double>& stock_prices) {
-        std::vector<double> log_returns = logarithmic_return_function(stock_prices);
-        double avg_return = average_return(log_returns);
-        double vol = volatility(log_returns, avg_return);
-        return vol;
+template <typename T>
+T volatility_algorithm(Series_View<T> stock_prices) {
+        size_t count = stock_prices.size() - 1;
+
+        double sum = 0.0;
+        for (size_t i = 0; i < count; ++i) {
+            sum += log_return(stock_prices, i);
+        }
+        T avg_return = static_cast<T>(sum / count);
+
+        double variance_result = 0.0;
+        for (size_t i = 0; i < count; ++i) {
+            variance_result = std::pow((static_cast<double>(log_return(stock_prices, i)) - avg_return), 2.0) + variance_result;
+        }
+        double variance = static_cast<double>(static_cast<T>(variance_result)) / (count - 1);
+        return static_cast<T>(std::sqrt(variance));
+};
+
+// Overloads for containers (std::vector, std::array, ...): they forward a read-only view, without copying
+
+template <std::ranges::contiguous_range Values>
+auto average(const Values& return_list) {
+    return average(view_of(return_list));
+};
+
+template <std::ranges::contiguous_range Values>
+auto average_return(const Values& r_average_list) {
+    return average_return(view_of(r_average_list));
+};
+
+template <std::ranges::contiguous_range Values>
+auto logarithmic_return_function(const Values& price) {
+    return logarithmic_return_function(view_of(price));
+};
+
+template <std::ranges::contiguous_range Values>
+auto iter_variance(const Values& log_return_for_time_period, std::ranges::range_value_t<Values> average_return_for_time_period) {
+    return iter_variance(view_of(log_return_for_time_period), average_return_for_time_period);
+};
+
+template <std::ranges::contiguous_range Values>
+auto volatility(const Values& log_return, std::ranges::range_value_t<Values> average) {
+    return volatility(view_of(log_return), average);
+};
+
+template <std::ranges::contiguous_range Values>
+auto volatility_algorithm(const Values& stock_prices) {
+    return volatility_algorithm(view_of(stock_prices));
 };
 
 
@@ -1,9 +1,12 @@
 #include "volatility_formula.h"
+#include "symbol_table.h"
 #include <iostream>
 #include <map>
 #include <vector>
 #include <string>
 #include <cmath>
+#include <limits>
+#include <span>
 
 using namespace VolatilityFunctions;
 
@@ -11,31 +14,30 @@ using namespace VolatilityFunctions;
 /**
  * @brief Computes hourly volatility for each stock ticker based on the first 6 data points.
  * 
- * This function iterates through the input map of tickers and their associated prices,
+ * This function iterates through the price series of every ticker,
  * computes the hourly volatility for the first 6 price points using the volatility algorithm,
- * and stores the results in a new map.
+ * and writes the results into a caller-provided buffer indexed by ticker ID.
+ * The prices are only viewed, never copied.
  * 
- * @param input_map A map where the key is the ticker (string) and the value is a vector of stock prices (doubles).
- * @return A map with the ticker as the key and the calculated volatility as the value.
+ * @param input_map The price series of each ticker, indexed by Ticker_Id (a Basic_Ticker_Series or any other Ticker_Collection).
+ * @param symbols The symbol table, used to name tickers in console messages.
+ * @param ticker_vol_map Receives the volatility of each ticker, NaN for tickers with less than 6 prices; must hold input_map.size() values.
  */
-std::map<std::string, double> ticker_to_vol_hourly(std::map<std::string, std::vector<double>> input_map) {
-    
-    std::map<std::string, double> ticker_vol_map;
+template <Ticker_Collection Series>
+void ticker_to_vol_hourly(const Series& input_map, const Symbol_Table& symbols, std::span<Ticker_Value<Series>> ticker_vol_map) {
+    using T = Ticker_Value<Series>;
 
-    for (const auto& pair : input_map) {
-        const std::string& ticker = pair.first;
-        const std::vector<double>& prices = pair.second;
+    for (Ticker_Id ticker = 0; ticker < input_map.size(); ++ticker) {
+        Series_View<T> prices = view_of(input_map[ticker]);
 
         if (prices.size() < 6) {
-            std::cout << " Not enough data for " << ticker << std::endl;
+            std::cout << " Not enough data for " << symbols.name(ticker) << std::endl;
+            ticker_vol_map[ticker] = std::numeric_limits<T>::quiet_NaN();
             continue;
         }
 
-        // Use only the first 6 values
-        std::vector<double> first_six_prices(prices.begin(), prices.begin() + 6);
-
-        // Calculation of Volatility
-        double vol_algo = volatility_algorithm(first_six_prices);
+        // Calculation of Volatility over a view of the first 6 values
+        T vol_algo = volatility_algorithm(prices.first(6));
 
         // Adding the value to the initial map for the past volatility calculations
         ticker_vol_map[ticker] = vol_algo;
@@ -60,47 +62,99 @@ std::map<std::string, double> ticker_to_vol_hourly(std::map<std::string, std::ve
         // std::cout << " Volatility: " << vol_algo << std::endl;
     
     };
-    
+}
+
+/**
+ * @brief Computes hourly volatility for each stock ticker based on the first 6 data points.
+ * 
+ * @param input_map The price series of each ticker, indexed by Ticker_Id.
+ * @param symbols The symbol table, used to name tickers in console messages.
+ * @return The calculated volatility of each ticker, NaN for tickers with less than 6 prices.
+ */
+template <Ticker_Collection Series>
+std::vector<Ticker_Value<Series>> ticker_to_vol_hourly(const Series& input_map, const Symbol_Table& symbols) {
+    std::vector<Ticker_Value<Series>> ticker_vol_map(input_map.size());
+    ticker_to_vol_hourly(input_map, symbols, std::span<Ticker_Value<Series>>(ticker_vol_map));
     return ticker_vol_map;
 }
 
+/**
+ * @brief Computes the EWMA volatility of one ticker over time into a caller-provided buffer.
+ * 
+ * @param prices A read-only view of the ticker's prices.
+ * @param initial_volatility The volatility of the first 6 prices (see ticker_to_vol_hourly).
+ * @param output Receives the volatility after each price from the 7th on; must hold prices.size() - 6 values.
+ * @param lambda The decay factor of the EWMA.
+ * @return The number of volatilities written (0 with 6 prices or less).
+ */
+template <typename T>
+size_t true_volatility_path(Series_View<T> prices, T initial_volatility, std::span<T> output, double lambda = 0.94) {
+    if (prices.size() <= 6) {
+        return 0;
+    }
+    T current_volatility = initial_volatility;
+    for (size_t i = 5; i < prices.size()-1; ++i) {
+        T old_price = prices[i];
+        T new_price = prices[i + 1];
+
+        current_volatility = update_volatility(current_volatility, new_price, old_price, lambda);
+        output[i - 5] = current_volatility;
+    }
+    return prices.size() - 6;
+}
+
 /**
  * @brief Computes the true volatility of stock tickers over time using the Exponentially Weighted Moving Average (EWMA) method.
  * 
- * This function calculates the true volatility for each stock ticker in the input map
- * based on its price history and an initial volatility value.
+ * This function calculates the true volatility for each stock ticker
+ * based on its price history and an initial volatility value (see true_volatility_path).
+ * The output series are resized in place, so a reused output keeps its memory between calls.
  * 
- * @param input_map A map where the key is the ticker (string) and the value is a vector of stock prices (doubles).
- * @param standard_ticker_vol_map A map where the key is the ticker and the value is the initial volatility (double) for that ticker.
- * @return A map where the key is the ticker and the value is a vector of volatilities over time.
+ * @param input_map The price series of each ticker, indexed by Ticker_Id (a Basic_Ticker_Series or any other Ticker_Collection).
+ * @param standard_ticker_vol_map The initial volatility of each ticker, indexed by Ticker_Id (NaN if unavailable).
+ * @param symbols The symbol table, used to name tickers in console messages.
+ * @param true_volatility_output Receives the volatilities over time of each ticker, indexed by Ticker_Id (empty if unavailable).
  */
-std::map<std::string, std::vector<double>> true_volatility(std::map<std::string, std::vector<double>> input_map, std::map<std::string, double> standard_ticker_vol_map){
+template <Ticker_Collection Series>
+void true_volatility(const Series& input_map, Series_View<Ticker_Value<Series>> standard_ticker_vol_map, const Symbol_Table& symbols,
+                     Basic_Ticker_Series<Ticker_Value<Series>>& true_volatility_output) {
+    using T = Ticker_Value<Series>;
     
     std::cout << "\n-----------------------------------\n";
 
-    std::map<std::string, std::vector<double>> true_volatility_output;
+    true_volatility_output.resize(input_map.size());
+    for (auto& volatilities : true_volatility_output) {
+        volatilities.clear();
+    }
             
-    for (const auto& pair : standard_ticker_vol_map) {
-        const std::string& ticker = pair.first;
-        const std::vector<double>& prices = input_map[ticker];
+    for (Ticker_Id ticker = 0; ticker < standard_ticker_vol_map.size(); ++ticker) {
+        if (std::isnan(standard_ticker_vol_map[ticker])) {
+            continue;
+        }
+        Series_View<T> prices = view_of(input_map[ticker]);
 
         if (prices.size() > 6) {
-            double current_volatility = pair.second;
-            double lambda = 0.94;
-
-            for (size_t i = 5; i < prices.size()-1; ++i) {
-                double old_price = prices[i];
-                double new_price = prices[i + 1];
-
-                current_volatility = update_volatility(current_volatility, new_price, old_price, lambda);
-                
-                // std::cout << current_volatility << std::endl;
-                true_volatility_output[ticker].push_back(current_volatility);
-            }
+            std::vector<T>& volatilities = true_volatility_output[ticker];
+            volatilities.resize(prices.size() - 6);
+            true_volatility_path(prices, standard_ticker_vol_map[ticker], std::span<T>(volatilities));
         } else {
-            std::cout << ticker << ": Not enough data" << std::endl;
+            std::cout << symbols.name(ticker) << ": Not enough data" << std::endl;
         }
     }
+};
 
+/**
+ * @brief Computes the true volatility of stock tickers over time using the Exponentially Weighted Moving Average (EWMA) method.
+ * 
+ * @param input_map The price series of each ticker, indexed by Ticker_Id.
+ * @param standard_ticker_vol_map The initial volatility of each ticker, indexed by Ticker_Id (NaN if unavailable).
+ * @param symbols The symbol table, used to name tickers in console messages.
+ * @return The volatilities over time of each ticker, indexed by Ticker_Id (empty if unavailable).
+ */
+template <Ticker_Collection Series>
+Basic_Ticker_Series<Ticker_Value<Series>> true_volatility(const Series& input_map, Series_View<Ticker_Value<Series>> standard_ticker_vol_map,
+                                                          const Symbol_Table& symbols) {
+    Basic_Ticker_Series<Ticker_Value<Series>> true_volatility_output;
+    true_volatility(input_map, standard_ticker_vol_map, symbols, true_volatility_output);
     return true_volatility_output;
 };
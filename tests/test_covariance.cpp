@@ -0,0 +1,111 @@
+#include "gtest/gtest.h"
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "covariance_engine.h"
+
+namespace {
+
+    // Dense EWMA covariance, updated entry by entry, as a reference for the tiled engine
+    struct Dense_Covariance {
+        Dense_Covariance(size_t n, double lambda) : n(n), lambda(lambda), matrix(n * n, 0.0) {}
+
+        void update(const std::vector<double>& returns) {
+            for (size_t i = 0; i < n; ++i) {
+                for (size_t j = 0; j < n; ++j) {
+                    matrix[i * n + j] = lambda * matrix[i * n + j] + (1.0 - lambda) * returns[i] * returns[j];
+                }
+            }
+            decay_power *= lambda;
+        }
+
+        double covariance(size_t i, size_t j) const {
+            return matrix[i * n + j] / (1.0 - decay_power);
+        }
+
+        size_t n;
+        double lambda;
+        std::vector<double> matrix;
+        double decay_power = 1.0;
+    };
+}
+
+class Ewma_Covariance_Test : public ::testing::TestWithParam<size_t> {};
+
+// Every query of the tiled engine matches the dense reference, including across the edges
+// of partial tiles (ticker counts that are not a multiple of the tile size)
+TEST_P(Ewma_Covariance_Test, MatchesDenseReference) {
+    const size_t n = GetParam();
+    const double lambda = 0.94;
+    std::mt19937 generator(3);
+    std::normal_distribution<double> move(0.0, 0.01);
+    std::uniform_real_distribution<double> weight(-1.0, 2.0);
+
+    Ewma_Covariance engine(n, lambda);
+    Dense_Covariance dense(n, lambda);
+    std::vector<double> returns(n);
+    for (size_t bar = 0; bar < 40; ++bar) {
+        double market = move(generator);
+        for (size_t i = 0; i < n; ++i) {
+            returns[i] = i % 7 == 3 ? 0.0 : market * (i % 3) + move(generator); // Correlated, some tickers without bars
+        }
+        engine.update(returns);
+        dense.update(returns);
+    }
+
+    const double tolerance = 1e-12;
+    std::vector<double> row;
+    for (size_t i = 0; i < n; ++i) {
+        engine.row(i, row);
+        ASSERT_EQ(row.size(), n);
+        for (size_t j = 0; j < n; ++j) {
+            double expected = dense.covariance(i, j);
+            EXPECT_NEAR(engine.covariance(i, j), expected, tolerance);
+            EXPECT_NEAR(row[j], expected, tolerance);
+            double denominator = std::sqrt(dense.covariance(i, i) * dense.covariance(j, j));
+            EXPECT_NEAR(engine.correlation(i, j), denominator > 0.0 ? expected / denominator : 0.0, 1e-9);
+        }
+        EXPECT_NEAR(engine.volatility(i), std::sqrt(dense.covariance(i, i)), 1e-9);
+    }
+
+    std::vector<double> weights(n);
+    for (double& value : weights) {
+        value = weight(generator);
+    }
+    std::vector<double> expected_product(n, 0.0);
+    double expected_variance = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = 0; j < n; ++j) {
+            expected_product[i] += dense.covariance(i, j) * weights[j];
+        }
+        expected_variance += weights[i] * expected_product[i];
+    }
+    std::vector<double> product(n);
+    engine.multiply(weights, product);
+    for (size_t i = 0; i < n; ++i) {
+        EXPECT_NEAR(product[i], expected_product[i], 1e-10);
+    }
+    EXPECT_NEAR(engine.portfolio_variance(weights), expected_variance, 1e-10);
+
+    // Weighted marginal contributions add up to the portfolio volatility
+    std::vector<double> contributions = engine.marginal_risk_contributions(weights);
+    double volatility = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        EXPECT_NEAR(contributions[i], expected_product[i] / std::sqrt(expected_variance), 1e-9);
+        volatility += weights[i] * contributions[i];
+    }
+    EXPECT_NEAR(volatility, std::sqrt(expected_variance), 1e-10);
+}
+
+INSTANTIATE_TEST_SUITE_P(Sizes, Ewma_Covariance_Test, ::testing::Values(size_t(1), size_t(5), size_t(64), size_t(65), size_t(130)));
+
+TEST(Ewma_Covariance_Test, EmptyAndMismatchedInputs) {
+    Ewma_Covariance engine(3);
+    EXPECT_EQ(engine.covariance(0, 1), 0.0);
+    EXPECT_EQ(engine.correlation(0, 1), 0.0);
+    EXPECT_EQ(engine.marginal_risk_contributions({1.0, 1.0, 1.0}), std::vector<double>(3, 0.0));
+    EXPECT_THROW(engine.update({0.01, 0.02}), std::invalid_argument);
+    std::vector<double> out(2);
+    EXPECT_THROW(engine.multiply(std::vector<double>(3, 1.0), out), std::invalid_argument);
+}
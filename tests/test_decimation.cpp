@@ -0,0 +1,147 @@
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "decimation.h"
+
+namespace {
+
+    // A noisy random walk with one spike up and one spike down
+    void make_series(size_t n, std::vector<double>& x, std::vector<double>& y) {
+        std::mt19937 generator(11);
+        std::normal_distribution<double> move(0.0, 1.0);
+        x.resize(n);
+        y.resize(n);
+        double value = 100.0;
+        for (size_t i = 0; i < n; ++i) {
+            value += move(generator);
+            x[i] = static_cast<double>(i);
+            y[i] = value;
+        }
+        y[n / 3] += 500.0;
+        y[2 * n / 3] -= 500.0;
+    }
+}
+
+// LTTB keeps exactly the target number of points, both endpoints, and the x order
+TEST(Decimation_Test, LttbKeepsEndpointsAndTargetSize) {
+    std::vector<double> x;
+    std::vector<double> y;
+    make_series(10007, x, y);
+    std::vector<double> out_x;
+    std::vector<double> out_y;
+    lttb_decimate(x, y, 500, out_x, out_y);
+
+    ASSERT_EQ(out_x.size(), 500u);
+    ASSERT_EQ(out_y.size(), 500u);
+    EXPECT_EQ(out_x.front(), x.front());
+    EXPECT_EQ(out_y.front(), y.front());
+    EXPECT_EQ(out_x.back(), x.back());
+    EXPECT_EQ(out_y.back(), y.back());
+    EXPECT_TRUE(std::is_sorted(out_x.begin(), out_x.end()));
+
+    // The spikes form the largest triangles of their buckets
+    EXPECT_EQ(*std::max_element(out_y.begin(), out_y.end()), *std::max_element(y.begin(), y.end()));
+    EXPECT_EQ(*std::min_element(out_y.begin(), out_y.end()), *std::min_element(y.begin(), y.end()));
+
+    // Short series are returned as they are
+    lttb_decimate(std::vector<double>(x.begin(), x.begin() + 100), std::vector<double>(y.begin(), y.begin() + 100), 500, out_x, out_y);
+    EXPECT_EQ(out_y, std::vector<double>(y.begin(), y.begin() + 100));
+}
+
+// Min/max bucketing keeps at most two points per bucket, and every bucket's extremes
+TEST(Decimation_Test, MinMaxPreservesEveryBucketsExtremes) {
+    std::vector<double> x;
+    std::vector<double> y;
+    make_series(10007, x, y);
+    const size_t buckets = 250;
+    std::vector<double> out_x;
+    std::vector<double> out_y;
+    min_max_decimate(x, y, buckets, out_x, out_y);
+
+    ASSERT_EQ(out_x.size(), 2 * buckets);
+    EXPECT_TRUE(std::is_sorted(out_x.begin(), out_x.end()));
+    for (size_t bucket = 0; bucket < buckets; ++bucket) {
+        size_t start = bucket * x.size() / buckets;
+        size_t end = (bucket + 1) * x.size() / buckets;
+        double low = *std::min_element(y.begin() + start, y.begin() + end);
+        double high = *std::max_element(y.begin() + start, y.begin() + end);
+        EXPECT_EQ(std::min(out_y[2 * bucket], out_y[2 * bucket + 1]), low);
+        EXPECT_EQ(std::max(out_y[2 * bucket], out_y[2 * bucket + 1]), high);
+    }
+
+    // decimate picks the method and spends the pixel budget on both extremes
+    decimate(x, y, 400, "minmax", out_x, out_y);
+    EXPECT_EQ(out_x.size(), 400u);
+    decimate(x, y, 400, "lttb", out_x, out_y);
+    EXPECT_EQ(out_x.size(), 400u);
+}
+
+TEST(Decimation_Test, DrawdownBelowRunningPeak) {
+    std::vector<double> drawdowns = drawdown_series({100.0, 120.0, 90.0, 60.0, 130.0, 117.0});
+    std::vector<double> expected = {0.0, 0.0, -25.0, -50.0, 0.0, -10.0};
+    ASSERT_EQ(drawdowns.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_NEAR(drawdowns[i], expected[i], 1e-12);
+    }
+    EXPECT_TRUE(drawdown_series({}).empty());
+}
+
+// Streaming decimation gives what min_max_decimate gives for its final bucket width,
+// and never keeps more than its bucket budget
+TEST(Decimation_Test, StreamingMatchesMinMaxInBoundedMemory) {
+    std::vector<double> x;
+    std::vector<double> y;
+    make_series(64 * 16, x, y);
+    Streaming_Decimator streaming(64);
+    for (size_t i = 0; i < x.size(); ++i) {
+        streaming.add(x[i], y[i]);
+        EXPECT_LE(streaming.buckets.size(), 64u);
+    }
+    std::vector<double> out_x;
+    std::vector<double> out_y;
+    streaming.points(out_x, out_y);
+    std::vector<double> expected_x;
+    std::vector<double> expected_y;
+    min_max_decimate(x, y, x.size() / streaming.points_per_bucket, expected_x, expected_y);
+    EXPECT_EQ(out_x, expected_x);
+    EXPECT_EQ(out_y, expected_y);
+
+    // Any length keeps the extremes
+    make_series(100003, x, y);
+    Streaming_Decimator long_series(100);
+    for (size_t i = 0; i < x.size(); ++i) {
+        long_series.add(x[i], y[i]);
+    }
+    long_series.points(out_x, out_y);
+    EXPECT_LE(out_x.size(), 200u);
+    EXPECT_TRUE(std::is_sorted(out_x.begin(), out_x.end()));
+    EXPECT_EQ(*std::max_element(out_y.begin(), out_y.end()), *std::max_element(y.begin(), y.end()));
+    EXPECT_EQ(*std::min_element(out_y.begin(), out_y.end()), *std::min_element(y.begin(), y.end()));
+}
+
+// The history keeps the deepest drawdown and only the chosen tickers
+TEST(Decimation_Test, PortfolioHistoryTracksTotalsAndChosenTickers) {
+    std::vector<double> x;
+    std::vector<double> y;
+    make_series(5000, x, y);
+    std::vector<double> portfolio = {1.0, 5.0, 3.0, 5.0};
+    Portfolio_History history(largest_positions(portfolio, 2), 50);
+    EXPECT_EQ(history.tickers, (std::vector<Ticker_Id>{1, 3}));
+    for (size_t i = 0; i < x.size(); ++i) {
+        portfolio[3] = y[i];
+        history.add(x[i], portfolio, y[i] + 1000.0);
+    }
+    std::vector<double> values(y.size());
+    std::transform(y.begin(), y.end(), values.begin(), [](double value) { return value + 1000.0; });
+    std::vector<double> drawdowns = drawdown_series(values);
+
+    std::vector<double> out_x;
+    std::vector<double> out_y;
+    history.drawdown.points(out_x, out_y);
+    EXPECT_NEAR(*std::min_element(out_y.begin(), out_y.end()), *std::min_element(drawdowns.begin(), drawdowns.end()), 1e-12);
+    history.ticker_values[1].points(out_x, out_y);
+    EXPECT_EQ(*std::max_element(out_y.begin(), out_y.end()), *std::max_element(y.begin(), y.end()));
+    EXPECT_LE(out_x.size(), 100u);
+}
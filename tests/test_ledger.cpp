@@ -0,0 +1,208 @@
+#include "gtest/gtest.h"
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <limits>
+#include <fstream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "ledger.h"
+#include "simulation.h"
+
+namespace {
+
+    // Random-walk hourly bars over several days, with some hours missing
+    std::vector<std::vector<Ohlcv_Bar>> make_bars(size_t n_tickers, size_t hours) {
+        std::mt19937 generator(7);
+        std::normal_distribution<double> move(0.0, 1.0);
+        std::uniform_int_distribution<int> gap(0, 9);
+        std::vector<std::vector<Ohlcv_Bar>> bars(n_tickers);
+        for (size_t stock = 0; stock < n_tickers; ++stock) {
+            double price = 40.0 + 5.0 * stock;
+            for (size_t hour = 0; hour < hours; ++hour) {
+                if (gap(generator) == 0) {
+                    continue;
+                }
+                price *= 1.0 + (0.002 + 0.001 * (stock % 5)) * move(generator);
+                Ohlcv_Bar bar;
+                bar.timestamp = 1700000000 + static_cast<long>(hour) * 3600;
+                bar.open = bar.high = bar.low = bar.close = price;
+                bar.volume = 5000.0;
+                bars[stock].push_back(bar);
+            }
+        }
+        return bars;
+    }
+
+    Symbol_Table make_symbols(size_t n_tickers) {
+        Symbol_Table symbols;
+        for (size_t stock = 0; stock < n_tickers; ++stock) {
+            symbols.intern("T" + std::to_string(stock));
+        }
+        return symbols;
+    }
+
+    Simulation_State make_state(size_t n_tickers) {
+        Simulation_State state(n_tickers, "optimistic", "strategy", 1000.0);
+        state.portfolio.assign(n_tickers, 1000.0 / n_tickers);
+        return state;
+    }
+
+    std::string read_file(const std::string& filename) {
+        std::ifstream in(filename, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    }
+}
+
+// Replaying the ledger with each step's closes gives the portfolio of every step, its queries
+// add up to the run's trades, and it holds nothing but the Open records and the trades
+TEST(Ledger_Test, ReplayAndQueriesMatchTheSimulation) {
+    const size_t n_tickers = 5;
+    const std::string filename = "test_ledger_replay.ledger";
+    std::remove(filename.c_str());
+    const auto bars = make_bars(n_tickers, 150);
+    const Symbol_Table symbols = make_symbols(n_tickers);
+
+    Simulation_State state = make_state(n_tickers);
+    std::map<long, std::vector<double>> portfolios;
+    std::map<long, std::vector<double>> closes;
+    std::map<long, double> traded_by_day;
+    size_t trades = 0;
+    {
+        Trade_Ledger ledger(filename, symbols);
+        run_simulation(state, bars, [&](const Simulation_Step& step) {
+            portfolios[step.timestamp] = step.portfolio;
+            closes[step.timestamp].assign(state.last_price.begin(), state.last_price.end());
+            double traded = step.reallocation_funds;
+            for (const auto& allocation : step.allocations) {
+                traded += allocation.second;
+                trades += allocation.second > 0.0 ? 1 : 0;
+            }
+            trades += step.selling_stocks.size();
+            if (traded > 0.0) {
+                traded_by_day[step.timestamp / 86400 * 86400] += traded;
+            }
+        }, &ledger);
+    }
+
+    Ledger_Reader reader(filename);
+    EXPECT_EQ(reader.symbols.names, symbols.names);
+    std::span<const Ledger_Record> records = reader.records();
+    EXPECT_EQ(records.front().type, Ledger_Type::Open);
+    EXPECT_GT(trades, 0u);
+    EXPECT_LE(records.size(), 2 * n_tickers + trades);
+
+    for (const auto& [timestamp, portfolio] : portfolios) {
+        std::vector<double> replayed = replay_portfolio(records, n_tickers, timestamp, closes[timestamp]);
+        for (Ticker_Id stock = 0; stock < n_tickers; ++stock) {
+            EXPECT_NEAR(replayed[stock], portfolio[stock], 1e-9 * (1.0 + portfolio[stock]));
+        }
+    }
+    EXPECT_EQ(replay_portfolio(records, n_tickers, 1700000000 - 1), std::vector<double>(n_tickers, 0.0));
+
+    const std::vector<double> last_closes(state.last_price.begin(), state.last_price.end());
+    std::vector<double> profit = ticker_profit(records, n_tickers, last_closes);
+    const double tolerance = std::is_same_v<Series_Value, float> ? 1e-6 : 1e-8; // The metrics use the rounded changes
+    for (Ticker_Id stock = 0; stock < n_tickers; ++stock) {
+        EXPECT_NEAR(profit[stock], state.metrics.ticker_profit[stock], tolerance);
+    }
+
+    std::vector<std::pair<long, double>> turnover = turnover_by_day(records);
+    ASSERT_EQ(turnover.size(), traded_by_day.size());
+    for (const auto& [day, traded] : turnover) {
+        EXPECT_NEAR(traded, traded_by_day[day], 1e-9);
+    }
+    std::remove(filename.c_str());
+}
+
+// A resumed simulation appends to the same ledger, which ends up identical to a single run's
+TEST(Ledger_Test, ReopenedLedgerContinuesTheRun) {
+    const size_t n_tickers = 4;
+    const std::string single_file = "test_ledger_single.ledger";
+    const std::string resumed_file = "test_ledger_resumed.ledger";
+    std::remove(single_file.c_str());
+    std::remove(resumed_file.c_str());
+    const auto bars = make_bars(n_tickers, 100);
+    const Symbol_Table symbols = make_symbols(n_tickers);
+
+    Simulation_State single = make_state(n_tickers);
+    {
+        Trade_Ledger ledger(single_file, symbols);
+        run_simulation(single, bars, nullptr, &ledger);
+    }
+
+    std::vector<std::vector<Ohlcv_Bar>> first_bars(n_tickers);
+    for (Ticker_Id stock = 0; stock < n_tickers; ++stock) {
+        for (const auto& bar : bars[stock]) {
+            if (bar.timestamp < 1700000000 + 40 * 3600) {
+                first_bars[stock].push_back(bar);
+            }
+        }
+    }
+    Simulation_State resumed = make_state(n_tickers);
+    {
+        Trade_Ledger ledger(resumed_file, symbols);
+        run_simulation(resumed, first_bars, nullptr, &ledger);
+    }
+    {
+        // A crash in the middle of a record leaves a partial record, dropped on reopening
+        std::ofstream out(resumed_file, std::ios::binary | std::ios::app);
+        out.write("partial", 7);
+    }
+    {
+        Trade_Ledger ledger(resumed_file, symbols);
+        run_simulation(resumed, bars, nullptr, &ledger);
+    }
+    EXPECT_EQ(read_file(resumed_file), read_file(single_file));
+
+    EXPECT_THROW(Trade_Ledger(resumed_file, make_symbols(n_tickers + 1)), std::runtime_error);
+    EXPECT_THROW(Ledger_Reader("does_not_exist.ledger"), std::runtime_error);
+    std::remove(single_file.c_str());
+    std::remove(resumed_file.c_str());
+}
+
+// Queries over a few million records, through the memory-mapped reader
+TEST(Ledger_Test, LargeLedger) {
+    const size_t n_tickers = 500;
+    const size_t n_records = 2000000;
+    const std::string filename = "test_ledger_large.ledger";
+    std::remove(filename.c_str());
+    const std::vector<double> closes(n_tickers, 10.0);
+    const std::vector<double> changes(n_tickers, std::nan(""));
+    {
+        Trade_Ledger ledger(filename, make_symbols(n_tickers));
+        for (size_t i = 0; i < n_records; ++i) {
+            if (i % n_tickers == 0) {
+                ledger.begin_step(1700000000 + static_cast<long>(i / n_tickers) * 3600, std::vector<double>(n_tickers, 0.0), closes, changes);
+            }
+            Ticker_Id stock = static_cast<Ticker_Id>(i % n_tickers);
+            ledger.append(i % 4 == 0 ? Ledger_Type::Sell : Ledger_Type::Allocate, stock, 1.0, static_cast<double>(i));
+        }
+        EXPECT_EQ(ledger.size(), n_tickers + n_records); // The Open records of the first step, then the trades
+    }
+    EXPECT_EQ(std::filesystem::file_size(filename) % sizeof(Ledger_Record), 0u);
+
+    Ledger_Reader reader(filename);
+    std::span<const Ledger_Record> records = reader.records();
+    ASSERT_EQ(records.size(), n_tickers + n_records);
+    std::vector<double> portfolio = replay_portfolio(records, n_tickers);
+    EXPECT_EQ(portfolio[0], static_cast<double>(n_records - n_tickers));
+    EXPECT_EQ(portfolio[n_tickers - 1], static_cast<double>(n_records - 1));
+
+    // Doubling every price doubles every position, and each ticker's profit is its last position
+    const std::vector<double> doubled(n_tickers, 20.0);
+    EXPECT_EQ(replay_portfolio(records, n_tickers, std::numeric_limits<long>::max(), doubled)[1], 2.0 * (n_records - n_tickers + 1));
+    std::vector<double> profit = ticker_profit(records, n_tickers, doubled);
+    EXPECT_EQ(profit[0], static_cast<double>(n_records - n_tickers));
+    EXPECT_EQ(profit[1], static_cast<double>(n_records - n_tickers + 1));
+    double traded = 0.0;
+    for (const auto& day : turnover_by_day(records)) {
+        traded += day.second;
+    }
+    EXPECT_EQ(traded, static_cast<double>(n_records));
+    std::remove(filename.c_str());
+}
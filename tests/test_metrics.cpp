@@ -0,0 +1,108 @@
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "metrics.h"
+
+namespace {
+
+    // Hourly portfolio values of a noisy random walk with a few sharp falls
+    std::vector<double> make_values(size_t n, unsigned seed) {
+        std::mt19937 generator(seed);
+        std::normal_distribution<double> move(0.0002, 0.004);
+        std::vector<double> values = {10000.0};
+        for (size_t i = 1; i < n; ++i) {
+            double period_return = i % 97 == 0 ? -0.03 : move(generator);
+            values.push_back(values.back() * (1.0 + period_return));
+        }
+        return values;
+    }
+
+    Performance_Metrics stream(const std::vector<double>& values) {
+        Performance_Metrics metrics(1);
+        metrics.start(values.front());
+        for (size_t i = 1; i < values.size(); ++i) {
+            metrics.add_ticker_profit(0, values[i] - values[i - 1]);
+            metrics.update(values[i], 0.1 * values[i - 1]);
+        }
+        return metrics;
+    }
+}
+
+// The streaming statistics match the ones computed from the stored history
+TEST(Performance_Metrics_Test, MatchesBatchStatistics) {
+    const std::vector<double> values = make_values(5000, 1);
+    const Performance_Metrics metrics = stream(values);
+
+    std::vector<double> returns;
+    for (size_t i = 1; i < values.size(); ++i) {
+        returns.push_back(values[i] / values[i - 1] - 1.0);
+    }
+    double mean = 0.0;
+    for (double r : returns) {
+        mean += r;
+    }
+    mean /= returns.size();
+    double variance = 0.0;
+    double downside = 0.0;
+    for (double r : returns) {
+        variance += (r - mean) * (r - mean);
+        downside += r < 0.0 ? r * r : 0.0;
+    }
+    variance /= returns.size() - 1;
+    downside /= returns.size();
+    double max_drawdown = 0.0;
+    double peak = values.front();
+    for (double value : values) {
+        peak = std::max(peak, value);
+        max_drawdown = std::max(max_drawdown, 1.0 - value / peak);
+    }
+    const double periods_per_year = 252.0 * 7.0;
+
+    EXPECT_EQ(metrics.periods(), returns.size());
+    EXPECT_NEAR(metrics.total_return(), values.back() / values.front() - 1.0, 1e-9);
+    EXPECT_NEAR(metrics.returns.mean, mean, 1e-12);
+    EXPECT_NEAR(metrics.volatility(), std::sqrt(variance * periods_per_year), 1e-9);
+    EXPECT_NEAR(metrics.sharpe_ratio(), mean / std::sqrt(variance) * std::sqrt(periods_per_year), 1e-6);
+    EXPECT_NEAR(metrics.sortino_ratio(), mean / std::sqrt(downside) * std::sqrt(periods_per_year), 1e-6);
+    EXPECT_DOUBLE_EQ(metrics.max_drawdown, max_drawdown);
+    EXPECT_NEAR(metrics.turnover, 0.05 * returns.size(), 1e-9);
+    EXPECT_NEAR(metrics.ticker_profit[0], values.back() - values.front(), 1e-6);
+}
+
+// Backtests run separately merge into the statistics of all their periods
+TEST(Performance_Metrics_Test, MergedBacktestsPoolTheirPeriods) {
+    const std::vector<double> first_values = make_values(3000, 2);
+    const std::vector<double> second_values = make_values(2000, 3);
+    Performance_Metrics merged = stream(first_values);
+    const Performance_Metrics second = stream(second_values);
+    merged.merge(second);
+
+    Running_Moments pooled;
+    for (const auto* values : {&first_values, &second_values}) {
+        for (size_t i = 1; i < values->size(); ++i) {
+            pooled.update((*values)[i] / (*values)[i - 1] - 1.0);
+        }
+    }
+    EXPECT_EQ(merged.periods(), pooled.n);
+    EXPECT_NEAR(merged.returns.mean, pooled.mean, 1e-12);
+    EXPECT_NEAR(merged.returns.variance(), pooled.variance(), 1e-12);
+    EXPECT_EQ(merged.max_drawdown, std::max(stream(first_values).max_drawdown, second.max_drawdown));
+    EXPECT_NEAR(merged.ticker_profit[0], first_values.back() - first_values.front() + second_values.back() - second_values.front(), 1e-6);
+}
+
+TEST(Performance_Metrics_Test, EmptyMetrics) {
+    Performance_Metrics metrics(3);
+    EXPECT_EQ(metrics.periods(), 0u);
+    EXPECT_EQ(metrics.total_return(), 0.0);
+    EXPECT_TRUE(std::isnan(metrics.sharpe_ratio()));
+    EXPECT_TRUE(std::isnan(metrics.sortino_ratio()));
+
+    // The first value only sets the starting point
+    metrics.start(100.0);
+    metrics.start(50.0);
+    metrics.update(110.0, 0.0);
+    EXPECT_EQ(metrics.periods(), 1u);
+    EXPECT_NEAR(metrics.total_return(), 0.1, 1e-12);
+}
@@ -0,0 +1,82 @@
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "quantile_sketch.h"
+
+namespace {
+
+    // Hourly volatilities of a heavy-tailed (lognormal) kind
+    std::vector<double> make_volatilities(size_t n, unsigned seed) {
+        std::mt19937 generator(seed);
+        std::lognormal_distribution<double> volatility(std::log(0.003), 0.5);
+        std::vector<double> values(n);
+        for (auto& value : values) {
+            value = volatility(generator);
+        }
+        return values;
+    }
+
+    // Fraction of the sorted values at or below a value
+    double exact_rank(const std::vector<double>& sorted, double value) {
+        return static_cast<double>(std::upper_bound(sorted.begin(), sorted.end(), value) - sorted.begin()) / sorted.size();
+    }
+}
+
+TEST(Quantile_Sketch_Test, QuantilesWithinRankError) {
+    const std::vector<double> values = make_volatilities(200000, 1);
+    Quantile_Sketch sketch;
+    for (double value : values) {
+        sketch.update(value);
+    }
+    std::vector<double> sorted = values;
+    std::sort(sorted.begin(), sorted.end());
+
+    EXPECT_EQ(sketch.count(), values.size());
+    EXPECT_LT(sketch.retained(), 3 * sketch.k + 64); // Bounded memory, whatever the count
+    EXPECT_EQ(sketch.quantile(0.0), sorted.front());
+    EXPECT_EQ(sketch.quantile(1.0), sorted.back());
+    for (double rank : {0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99}) {
+        EXPECT_NEAR(exact_rank(sorted, sketch.quantile(rank)), rank, 0.02) << rank;
+        EXPECT_NEAR(sketch.rank(sorted[static_cast<size_t>(rank * sorted.size())]), rank, 0.02) << rank;
+    }
+}
+
+// Sketches filled on separate threads or shards merge into one as accurate as a single sketch
+TEST(Quantile_Sketch_Test, MergedShardsMatchTheWholeStream) {
+    std::vector<double> values;
+    Quantile_Sketch merged;
+    for (unsigned shard = 0; shard < 8; ++shard) {
+        std::vector<double> shard_values = make_volatilities(5000 + 3000 * shard, 10 + shard);
+        Quantile_Sketch sketch;
+        for (double value : shard_values) {
+            sketch.update(value);
+        }
+        merged.merge(sketch);
+        values.insert(values.end(), shard_values.begin(), shard_values.end());
+    }
+    std::sort(values.begin(), values.end());
+
+    EXPECT_EQ(merged.count(), values.size());
+    EXPECT_LT(merged.retained(), 3 * merged.k + 64);
+    std::vector<double> ranks = {0.05, 0.25, 0.5, 0.75, 0.95};
+    std::vector<double> quantiles = merged.quantiles(ranks);
+    for (size_t i = 0; i < ranks.size(); ++i) {
+        EXPECT_NEAR(exact_rank(values, quantiles[i]), ranks[i], 0.02) << ranks[i];
+    }
+}
+
+TEST(Quantile_Sketch_Test, SmallAndEmptySketches) {
+    Quantile_Sketch sketch;
+    EXPECT_TRUE(std::isnan(sketch.quantile(0.5)));
+    sketch.update(std::nan(""));
+    EXPECT_EQ(sketch.count(), 0u);
+
+    // Exact until the first compaction
+    for (double value : {5.0, 1.0, 4.0, 2.0, 3.0}) {
+        sketch.update(value);
+    }
+    EXPECT_EQ(sketch.quantile(0.5), 3.0);
+    EXPECT_EQ(sketch.rank(2.0), 0.4);
+}
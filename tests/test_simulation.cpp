@@ -0,0 +1,496 @@
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "checkpoint.h"
+#include "execution.h"
+#include "simulation.h"
+#include "time_index.h"
+
+namespace {
+
+    // Random-walk hourly bars with volatilities from 0.2% to 0.7% per hour, so the managers
+    // both buy and sell; the last ticker starts late and every ticker skips a few hours
+    std::vector<std::vector<Ohlcv_Bar>> make_bars(size_t n_tickers, size_t hours, double volatility_scale = 1.0) {
+        std::mt19937 generator(42);
+        std::normal_distribution<double> move(0.0, 1.0);
+        std::uniform_int_distribution<int> gap(0, 9);
+        std::vector<std::vector<Ohlcv_Bar>> bars(n_tickers);
+        for (size_t stock = 0; stock < n_tickers; ++stock) {
+            double price = 50.0 + 10.0 * stock;
+            size_t first_hour = stock + 1 == n_tickers ? hours / 3 : 0;
+            for (size_t hour = first_hour; hour < hours; ++hour) {
+                if (gap(generator) == 0) {
+                    continue;
+                }
+                price *= 1.0 + volatility_scale * (0.002 + 0.001 * (stock % 6)) * move(generator);
+                Ohlcv_Bar bar;
+                bar.timestamp = 1700000000 + static_cast<long>(hour) * 3600;
+                bar.open = bar.high = bar.low = bar.close = price;
+                bar.volume = 2000.0;
+                bars[stock].push_back(bar);
+            }
+        }
+        return bars;
+    }
+
+    Symbol_Table make_symbols(size_t n_tickers) {
+        Symbol_Table symbols;
+        for (size_t stock = 0; stock < n_tickers; ++stock) {
+            symbols.intern("T" + std::to_string(stock));
+        }
+        return symbols;
+    }
+
+    Simulation_State make_state(size_t n_tickers, const std::string& strategy, const std::string& allocation_mode,
+                                const std::string& execution_mode = "instant", const std::string& threshold_mode = "fixed") {
+        Simulation_State state(n_tickers, strategy, allocation_mode, 1000.0, execution_mode, threshold_mode);
+        for (auto& value : state.portfolio) {
+            value = 1000.0 / n_tickers;
+        }
+        return state;
+    }
+
+    // Keeps the bars up to (and including) a timestamp
+    std::vector<std::vector<Ohlcv_Bar>> bars_until(const std::vector<std::vector<Ohlcv_Bar>>& bars, long timestamp) {
+        std::vector<std::vector<Ohlcv_Bar>> result(bars.size());
+        for (size_t stock = 0; stock < bars.size(); ++stock) {
+            for (const auto& bar : bars[stock]) {
+                if (bar.timestamp <= timestamp) {
+                    result[stock].push_back(bar);
+                }
+            }
+        }
+        return result;
+    }
+
+    struct Recorded_Step {
+        long timestamp;
+        size_t hour;
+        double reallocation_funds;
+        std::vector<double> portfolio;
+    };
+
+    std::function<void(const Simulation_Step&)> recorder(std::vector<Recorded_Step>& steps) {
+        return [&steps](const Simulation_Step& step) {
+            steps.push_back({step.timestamp, step.hour, step.reallocation_funds, step.portfolio});
+        };
+    }
+}
+
+class Checkpoint_Resume_Test : public ::testing::TestWithParam<std::tuple<std::string, std::string, std::string, std::string>> {};
+
+// Saving halfway, loading into a fresh state and resuming must give exactly the full replay
+TEST_P(Checkpoint_Resume_Test, ResumeMatchesFullReplay) {
+    const auto& [strategy, allocation_mode, execution_mode, threshold_mode] = GetParam();
+    const size_t n_tickers = 6;
+    const auto bars = make_bars(n_tickers, 200);
+    const Symbol_Table symbols = make_symbols(n_tickers);
+    const std::string filename = "test_simulation_" + strategy + "_" + allocation_mode + "_" + execution_mode + "_" + threshold_mode + ".ckpt";
+
+    Simulation_State full = make_state(n_tickers, strategy, allocation_mode, execution_mode, threshold_mode);
+    std::vector<Recorded_Step> full_steps;
+    run_simulation(full, bars, recorder(full_steps));
+
+    for (long split_hour : {3L, 50L, 120L}) {
+        Simulation_State first = make_state(n_tickers, strategy, allocation_mode, execution_mode, threshold_mode);
+        std::vector<Recorded_Step> steps;
+        run_simulation(first, bars_until(bars, 1700000000 + split_hour * 3600), recorder(steps));
+        ASSERT_TRUE(save_checkpoint(filename, first, symbols));
+
+        Simulation_State resumed;
+        ASSERT_TRUE(load_checkpoint(filename, resumed, symbols));
+        run_simulation(resumed, bars, recorder(steps));
+
+        ASSERT_EQ(steps.size(), full_steps.size());
+        for (size_t i = 0; i < steps.size(); ++i) {
+            EXPECT_EQ(steps[i].timestamp, full_steps[i].timestamp);
+            EXPECT_EQ(steps[i].hour, full_steps[i].hour);
+            EXPECT_EQ(steps[i].reallocation_funds, full_steps[i].reallocation_funds);
+            EXPECT_EQ(steps[i].portfolio, full_steps[i].portfolio);
+        }
+        EXPECT_EQ(resumed.portfolio, full.portfolio);
+        EXPECT_EQ(resumed.hours_processed, full.hours_processed);
+        EXPECT_EQ(resumed.last_timestamp, full.last_timestamp);
+        EXPECT_EQ(resumed.manager.covariance.tiles, full.manager.covariance.tiles);
+        EXPECT_EQ(resumed.execution.fees_paid, full.execution.fees_paid);
+        EXPECT_EQ(resumed.metrics.periods(), full.metrics.periods());
+        EXPECT_EQ(resumed.metrics.returns.m2, full.metrics.returns.m2);
+        EXPECT_EQ(resumed.metrics.max_drawdown, full.metrics.max_drawdown);
+        EXPECT_EQ(resumed.metrics.ticker_contribution, full.metrics.ticker_contribution);
+    }
+    std::remove(filename.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(Strategies, Checkpoint_Resume_Test, ::testing::Values(
+    std::make_tuple(std::string("optimistic"), std::string("strategy"), std::string("instant"), std::string("fixed")),
+    std::make_tuple(std::string("neutral"), std::string("strategy"), std::string("instant"), std::string("fixed")),
+    std::make_tuple(std::string("conservative"), std::string("strategy"), std::string("instant"), std::string("fixed")),
+    std::make_tuple(std::string("neutral"), std::string("min_variance"), std::string("instant"), std::string("fixed")),
+    std::make_tuple(std::string("optimistic"), std::string("mean_variance"), std::string("instant"), std::string("fixed")),
+    std::make_tuple(std::string("conservative"), std::string("risk_parity"), std::string("instant"), std::string("fixed")),
+    std::make_tuple(std::string("conservative"), std::string("strategy"), std::string("costs"), std::string("fixed")),
+    std::make_tuple(std::string("optimistic"), std::string("min_variance"), std::string("order_book"), std::string("fixed")),
+    std::make_tuple(std::string("conservative"), std::string("strategy"), std::string("instant"), std::string("ticker")),
+    std::make_tuple(std::string("neutral"), std::string("risk_parity"), std::string("costs"), std::string("universe"))));
+
+TEST(Simulation_Test, RerunWithoutNewBarsIsNoOp) {
+    const auto bars = make_bars(4, 50);
+    Simulation_State state = make_state(4, "neutral", "strategy");
+    EXPECT_GT(run_simulation(state, bars), 0u);
+
+    std::vector<double> portfolio = state.portfolio;
+    EXPECT_EQ(run_simulation(state, bars), 0u);
+    EXPECT_EQ(state.portfolio, portfolio);
+}
+
+// Simulating in single precision follows the double-precision run: with volatilities well away
+// from the thresholds, both make the same decisions and end with the same value within float rounding
+TEST(Simulation_Test, FloatSeriesMatchDoublePath) {
+    const std::vector<double> ticker_volatility = {0.001, 0.0015, 0.006, 0.008};
+    const size_t n_tickers = ticker_volatility.size();
+    std::mt19937 generator(7);
+    std::normal_distribution<double> move(0.0, 1.0);
+    std::vector<std::vector<Ohlcv_Bar>> bars(n_tickers);
+    for (size_t stock = 0; stock < n_tickers; ++stock) {
+        double price = 40.0 + 25.0 * stock;
+        for (size_t hour = 0; hour < 400; ++hour) {
+            price *= 1.0 + ticker_volatility[stock] * move(generator);
+            Ohlcv_Bar bar;
+            bar.timestamp = 1700000000 + static_cast<long>(hour) * 3600;
+            bar.open = bar.high = bar.low = bar.close = price;
+            bar.volume = 2000.0;
+            bars[stock].push_back(bar);
+        }
+    }
+
+    Basic_Simulation_State<double> full(n_tickers, "conservative", "strategy", 1000.0);
+    Basic_Simulation_State<float> single(n_tickers, "conservative", "strategy", 1000.0);
+    std::fill(full.portfolio.begin(), full.portfolio.end(), 1000.0 / n_tickers);
+    single.portfolio = full.portfolio;
+    size_t full_sells = 0;
+    size_t single_sells = 0;
+    run_simulation(full, bars, [&](const Basic_Simulation_Step<double>& step) { full_sells += step.selling_stocks.size(); });
+    run_simulation(single, bars, [&](const Basic_Simulation_Step<float>& step) { single_sells += step.selling_stocks.size(); });
+
+    EXPECT_GT(full_sells, 0u);
+    EXPECT_EQ(single_sells, full_sells);
+    EXPECT_NEAR(portfolio_value(single), portfolio_value(full), 1e-4 * portfolio_value(full));
+    for (Ticker_Id stock = 0; stock < n_tickers; ++stock) {
+        EXPECT_NEAR(single.volatility[stock], full.volatility[stock], 1e-3 * full.volatility[stock]);
+        EXPECT_NEAR(single.portfolio[stock], full.portfolio[stock], 1e-4 * (1.0 + full.portfolio[stock]));
+    }
+}
+
+// With volatilities ten times higher than the tuned constants, the fixed thresholds sell
+// every stock every hour; calibrated thresholds still tell calm stocks from volatile ones
+TEST(Simulation_Test, CalibratedThresholdsFollowTheVolatilityScale) {
+    const size_t n_tickers = 6;
+    const auto bars = make_bars(n_tickers, 300, 10.0);
+    for (const std::string threshold_mode : {"fixed", "ticker", "universe"}) {
+        Simulation_State state = make_state(n_tickers, "conservative", "strategy", "instant", threshold_mode);
+        size_t buys = 0;
+        size_t sells = 0;
+        run_simulation(state, bars, [&](const Simulation_Step& step) {
+            buys += step.buying_stocks.size();
+            sells += step.selling_stocks.size();
+        });
+        if (threshold_mode == "fixed") {
+            EXPECT_EQ(buys, 0u);
+        } else {
+            EXPECT_GT(buys, sells / 4) << threshold_mode;
+            EXPECT_GT(sells, buys / 4) << threshold_mode;
+        }
+    }
+}
+
+// The metrics updated in the loop agree with the recorded portfolio, the tickers' profits
+// explain every change in value that did not come from trading or its costs, and the
+// turnover is the value actually traded (not the leftover cash of partially filled buys)
+TEST(Simulation_Test, MetricsFollowThePortfolio) {
+    const size_t n_tickers = 6;
+    const auto bars = make_bars(n_tickers, 300);
+    for (const std::string execution_mode : {"instant", "costs", "order_book"}) {
+        SCOPED_TRACE(execution_mode);
+        Simulation_State state = make_state(n_tickers, "optimistic", "strategy", execution_mode);
+        state.execution.book_depth = 1e-5; // Thin books, so buys leave cash over
+        std::vector<double> values = {1000.0};
+        double unallocated = 0.0;
+        double traded = 0.0;
+        run_simulation(state, bars, [&](const Simulation_Step& step) {
+            values.push_back(portfolio_value(state));
+            double allocated = 0.0;
+            for (const auto& allocation : step.allocations) {
+                allocated += allocation.second;
+            }
+            unallocated += step.reallocation_funds - allocated; // Funds freed up with nothing to buy
+            traded += step.sold + std::accumulate(step.filled.begin(), step.filled.end(), 0.0);
+        });
+
+        double peak = values.front();
+        double max_drawdown = 0.0;
+        for (double value : values) {
+            peak = std::max(peak, value);
+            max_drawdown = std::max(max_drawdown, 1.0 - value / peak);
+        }
+        double profit = std::accumulate(state.metrics.ticker_profit.begin(), state.metrics.ticker_profit.end(), 0.0);
+        double costs = state.execution.fees_paid + state.execution.slippage_paid;
+        EXPECT_EQ(state.metrics.periods(), state.hours_processed);
+        EXPECT_NEAR(state.metrics.total_return(), values.back() / values.front() - 1.0, 1e-9);
+        EXPECT_NEAR(state.metrics.max_drawdown, max_drawdown, 1e-12);
+        EXPECT_NEAR(profit, values.back() - values.front() + unallocated + costs, 1e-6);
+        EXPECT_GT(state.metrics.turnover, 0.0);
+        EXPECT_NEAR(state.metrics.traded, traded, 1e-6);
+        if (execution_mode != "instant") {
+            EXPECT_GT(costs, 0.0);
+            EXPECT_NEAR(state.metrics.traded, state.execution.turnover, 1e-6);
+        }
+    }
+}
+
+TEST(Checkpoint_Test, RejectsOtherTickersAndBadFiles) {
+    const std::string filename = "test_simulation_invalid.ckpt";
+    Simulation_State state = make_state(3, "neutral", "strategy");
+    ASSERT_TRUE(save_checkpoint(filename, state, make_symbols(3)));
+
+    Simulation_State loaded;
+    EXPECT_FALSE(load_checkpoint(filename, loaded, make_symbols(4)));
+    EXPECT_FALSE(load_checkpoint("does_not_exist.ckpt", loaded, make_symbols(3)));
+
+    // Truncated file
+    std::ifstream in(filename, std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    out.write(contents.data(), contents.size() / 2);
+    out.close();
+    EXPECT_FALSE(load_checkpoint(filename, loaded, make_symbols(3)));
+    std::remove(filename.c_str());
+}
+
+TEST(Time_Index_Test, AddMonthsClampsToMonthEnd) {
+    long january_31 = days_from_civil(2024, 1, 31) * 86400 + 3600;
+    EXPECT_EQ(add_months(january_31, 1), days_from_civil(2024, 2, 29) * 86400 + 3600);
+    EXPECT_EQ(add_months(january_31, 13), days_from_civil(2025, 2, 28) * 86400 + 3600);
+    EXPECT_EQ(add_months(january_31, -2), days_from_civil(2023, 11, 30) * 86400 + 3600);
+    EXPECT_EQ(days_from_civil(1970, 1, 1), 0);
+}
+
+TEST(Time_Index_Test, SliceMatchesFilteredCopy) {
+    const auto bars = make_bars(5, 400);
+    Time_Index index(bars);
+    for (long start_hour : {-10L, 0L, 7L, 100L, 333L}) {
+        for (long length : {1L, 24L, 150L, 1000L}) {
+            long start = 1700000000 + start_hour * 3600;
+            long end = start + length * 3600;
+            std::vector<Bar_Range> ranges = index.slice(start, end);
+            for (size_t stock = 0; stock < bars.size(); ++stock) {
+                std::vector<long> expected;
+                for (const auto& bar : bars[stock]) {
+                    if (bar.timestamp >= start && bar.timestamp < end) {
+                        expected.push_back(bar.timestamp);
+                    }
+                }
+                std::vector<long> sliced;
+                for (const auto& bar : ranges[stock]) {
+                    sliced.push_back(bar.timestamp);
+                }
+                EXPECT_EQ(sliced, expected);
+                // Views point into the loaded data
+                EXPECT_TRUE(ranges[stock].empty() || (ranges[stock].begin() >= bars[stock].data() &&
+                                                      ranges[stock].end() <= bars[stock].data() + bars[stock].size()));
+            }
+        }
+    }
+}
+
+TEST(Time_Index_Test, SimulatingSliceMatchesSimulatingCopy) {
+    const auto bars = make_bars(5, 400);
+    Time_Index index(bars);
+    long start = 1700000000 + 50 * 3600;
+    long end = 1700000000 + 250 * 3600;
+
+    std::vector<std::vector<Ohlcv_Bar>> copied(bars.size());
+    for (size_t stock = 0; stock < bars.size(); ++stock) {
+        for (const auto& bar : bars[stock]) {
+            if (bar.timestamp >= start && bar.timestamp < end) {
+                copied[stock].push_back(bar);
+            }
+        }
+    }
+
+    Simulation_State from_slice = make_state(5, "conservative", "min_variance");
+    Simulation_State from_copy = make_state(5, "conservative", "min_variance");
+    run_simulation(from_slice, index.slice(start, end));
+    run_simulation(from_copy, copied);
+    EXPECT_EQ(from_slice.portfolio, from_copy.portfolio);
+    EXPECT_EQ(from_slice.hours_processed, from_copy.hours_processed);
+}
+
+TEST(Time_Index_Test, RollingMonthWindows) {
+    long start = days_from_civil(2024, 1, 15) * 86400;
+    long end = days_from_civil(2024, 7, 1) * 86400;
+    auto windows = rolling_month_windows(start, end, 3, 1);
+    ASSERT_EQ(windows.size(), 3u);
+    EXPECT_EQ(windows[0].second, days_from_civil(2024, 4, 15) * 86400);
+    EXPECT_EQ(windows[2].first, days_from_civil(2024, 3, 15) * 86400);
+}
+
+// 30-minute bars of a 9:30-16:00 session, resampled with a half-hour offset, give Yahoo's hourly bars
+TEST(Bar_Resampler_Test, OffsetAlignsToSessionHours) {
+    const long open = days_from_civil(2024, 3, 4) * 86400 + 14 * 3600 + 1800; // 9:30 EST
+    std::vector<Ohlcv_Bar> fine;
+    for (long i = 0; i < 13; ++i) {
+        Ohlcv_Bar bar;
+        bar.timestamp = open + i * 1800;
+        bar.open = 100.0 + i;
+        bar.high = 101.0 + i;
+        bar.low = 99.0 + i;
+        bar.close = 100.5 + i;
+        bar.volume = 10.0;
+        fine.push_back(bar);
+    }
+
+    std::vector<Ohlcv_Bar> hourly = resample(fine, "1h", 1800);
+    ASSERT_EQ(hourly.size(), 7u); // 9:30, 10:30, ..., 15:30 (a half hour)
+    for (size_t hour = 0; hour < hourly.size(); ++hour) {
+        EXPECT_EQ(hourly[hour].timestamp, open + static_cast<long>(hour) * 3600);
+        EXPECT_EQ(hourly[hour].open, fine[2 * hour].open);
+        EXPECT_EQ(hourly[hour].low, fine[2 * hour].low);
+        EXPECT_EQ(hourly[hour].close, fine[std::min(2 * hour + 1, fine.size() - 1)].close);
+    }
+    EXPECT_EQ(hourly[0].high, fine[1].high);
+    EXPECT_EQ(hourly[0].volume, 20.0);
+    EXPECT_EQ(hourly[6].volume, 10.0);
+
+    // Epoch-aligned buckets split every session hour in two
+    std::vector<Ohlcv_Bar> aligned = resample(fine, "1h");
+    ASSERT_EQ(aligned.size(), 7u);
+    EXPECT_EQ(aligned[0].timestamp, open - 1800);
+    EXPECT_EQ(aligned[0].volume, 10.0);
+}
+
+TEST(Execution_Test, OrderBookWalksLevels) {
+    Limit_Order_Book book(16);
+    book.reset(100.0, 0.01, 10);
+    book.add_limit(false, 100.01, 10.0);
+    book.add_limit(false, 100.02, 10.0);
+    book.add_limit(true, 99.99, 10.0);
+    book.add_limit(true, 99.98, 10.0);
+
+    // Buys the whole first ask level and part of the second
+    Book_Execution bought = book.market_buy(1500.25);
+    EXPECT_NEAR(bought.notional, 1500.25, 1e-9);
+    EXPECT_NEAR(bought.quantity, 10.0 + 500.15 / 100.02, 1e-9);
+
+    // Sells more than the bids hold: fills what is there
+    Book_Execution sold = book.market_sell(25.0);
+    EXPECT_NEAR(sold.quantity, 20.0, 1e-9);
+    EXPECT_NEAR(sold.notional, 10.0 * 99.99 + 10.0 * 99.98, 1e-9);
+    EXPECT_FALSE(book.has_bid);
+
+    // A reset empties the touched levels
+    book.reset(50.0, 0.01, 10);
+    EXPECT_FALSE(book.has_ask);
+    EXPECT_EQ(book.market_buy(100.0).quantity, 0.0);
+}
+
+// A sub-dollar stock gets a sub-penny grid and no bids at or below zero
+TEST(Execution_Test, OrderBookPricesStayPositive) {
+    Execution_Simulator execution(1, "order_book");
+    execution.start_step();
+    execution.observe(0, 0.004, 1e6, 0.01);
+
+    // Sells far more than the book shows, walking every bid
+    Execution_Fill fill = execution.sell(0, 1000.0);
+    double shares = -fill.position_change / 0.004;
+    double proceeds = fill.cash_change + fill.fees;
+    EXPECT_GT(shares, 0.0);
+    EXPECT_GT(fill.cash_change, 0.0);
+    EXPECT_GT(proceeds / shares, 0.0);
+    EXPECT_LT(proceeds / shares, 0.004);
+    for (size_t level = 0; level < execution.books[0].bid_quantity.size(); ++level) {
+        EXPECT_EQ(execution.books[0].bid_quantity[level], 0.0); // All shown bids were positive and taken
+    }
+}
+
+// Orders in the same step share one book; the next step shows fresh liquidity
+TEST(Execution_Test, OrdersInOneStepConsumeTheBook) {
+    Execution_Simulator execution(1, "order_book");
+    execution.start_step();
+    execution.observe(0, 50.0, 10000.0, 0.01);
+
+    Execution_Fill first = execution.buy(0, 5000.0);
+    Execution_Fill second = execution.buy(0, 5000.0);
+    EXPECT_GT(first.position_change, 0.0);
+    EXPECT_GT(second.slippage, first.slippage); // Walks the levels the first order left
+
+    execution.start_step();
+    execution.observe(0, 50.0, 10000.0, 0.01);
+    Execution_Fill next = execution.buy(0, 5000.0);
+    EXPECT_DOUBLE_EQ(next.position_change, first.position_change);
+    EXPECT_DOUBLE_EQ(next.slippage, first.slippage);
+}
+
+TEST(Execution_Test, CostsLowerTheFinalValue) {
+    const auto bars = make_bars(5, 300);
+    double final_values[3];
+    const std::string modes[3] = {"instant", "costs", "order_book"};
+    for (int i = 0; i < 3; ++i) {
+        Simulation_State state = make_state(5, "conservative", "strategy", modes[i]);
+        run_simulation(state, bars);
+        final_values[i] = std::accumulate(state.portfolio.begin(), state.portfolio.end(), 0.0) + state.execution.cash;
+        if (i > 0) {
+            EXPECT_GT(state.execution.orders, 0u);
+            EXPECT_GT(state.execution.fees_paid, 0.0);
+            EXPECT_GT(state.execution.slippage_paid, 0.0);
+        }
+    }
+    EXPECT_LT(final_values[1], final_values[0]);
+    EXPECT_LT(final_values[2], final_values[0]);
+}
+
+// With fewer active tickers than the cap allows, the cap is raised so the weights still add up to 1
+TEST(Allocation_Optimizer_Test, TwoActiveTickersAreFullyInvested) {
+    std::mt19937 generator(5);
+    std::normal_distribution<double> move(0.0, 0.01);
+    const std::vector<bool> active = {false, true, false, true, false};
+    for (const std::string mode : {"min_variance", "mean_variance", "risk_parity"}) {
+        Portfolio_Manager_State manager(5, mode, "neutral");
+        for (int hour = 0; hour < 50; ++hour) {
+            std::vector<double> returns(5);
+            for (double& value : returns) {
+                value = move(generator);
+            }
+            manager.covariance.update(returns);
+        }
+        const std::vector<double>& weights = manager.optimizer.solve(manager.covariance, manager.expected_returns, active);
+        double total = 0.0;
+        for (size_t i = 0; i < weights.size(); ++i) {
+            total += weights[i];
+            EXPECT_LE(weights[i], 0.5 + 1e-12) << mode;
+            if (!active[i]) {
+                EXPECT_EQ(weights[i], 0.0) << mode;
+            }
+        }
+        EXPECT_NEAR(total, 1.0, 1e-9) << mode;
+    }
+}
+
+TEST(Allocation_Optimizer_Test, ConfiguredCapIsApplied) {
+    std::mt19937 generator(6);
+    std::normal_distribution<double> move(0.0, 0.01);
+    Portfolio_Manager_State manager(4, "min_variance", "neutral", 0.94, 0.3);
+    for (int hour = 0; hour < 50; ++hour) {
+        // The first ticker is much calmer, so the uncapped minimum variance would load it up
+        std::vector<double> returns = {0.1 * move(generator), move(generator), move(generator), move(generator)};
+        manager.covariance.update(returns);
+    }
+    const std::vector<double>& weights = manager.optimizer.solve(manager.covariance, manager.expected_returns, std::vector<bool>(4, true));
+    EXPECT_NEAR(weights[0], 0.3, 1e-6);
+    EXPECT_NEAR(std::accumulate(weights.begin(), weights.end(), 0.0), 1.0, 1e-9);
+}
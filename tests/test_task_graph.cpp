@@ -0,0 +1,98 @@
+#include "gtest/gtest.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "task_graph.h"
+
+// Every task of a fetch -> parse -> derive chain runs after the task before it
+TEST(Task_Graph_Test, RunsDependenciesFirst) {
+    const size_t n_tickers = 16;
+    std::mutex mutex;
+    std::vector<std::vector<int>> stages(n_tickers);
+
+    Task_Graph graph;
+    std::vector<Task_Graph::Task_Id> last_stages;
+    for (size_t stock = 0; stock < n_tickers; ++stock) {
+        Task_Graph::Task_Id previous = 0;
+        for (int stage = 0; stage < 3; ++stage) {
+            auto work = [&, stock, stage]() {
+                std::lock_guard<std::mutex> lock(mutex);
+                stages[stock].push_back(stage);
+            };
+            previous = stage == 0 ? graph.add_task(work) : graph.add_task(work, {previous});
+        }
+        last_stages.push_back(previous);
+    }
+
+    // The barrier sees every chain complete
+    bool all_done = false;
+    graph.add_task([&]() {
+        all_done = true;
+        for (const auto& done : stages) {
+            all_done = all_done && done.size() == 3;
+        }
+    }, last_stages);
+    graph.run(4);
+
+    EXPECT_TRUE(all_done);
+    for (const auto& done : stages) {
+        EXPECT_EQ(done, (std::vector<int>{0, 1, 2}));
+    }
+}
+
+// Independent chains run at the same time: two tasks that wait for each other finish
+TEST(Task_Graph_Test, OverlapsIndependentTasks) {
+    std::atomic<int> started{0};
+    auto rendezvous = [&]() {
+        ++started;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (started < 2 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+        if (started < 2) {
+            throw std::runtime_error("tasks did not overlap");
+        }
+    };
+    Task_Graph graph;
+    graph.add_task(rendezvous);
+    graph.add_task(rendezvous);
+    EXPECT_NO_THROW(graph.run(2));
+}
+
+TEST(Task_Graph_Test, RethrowsAndSkipsDependents) {
+    bool dependent_ran = false;
+    Task_Graph graph;
+    Task_Graph::Task_Id failing = graph.add_task([]() { throw std::runtime_error("download failed"); });
+    graph.add_task([&]() { dependent_ran = true; }, {failing});
+    EXPECT_THROW(graph.run(2), std::runtime_error);
+    EXPECT_FALSE(dependent_ran);
+}
+
+TEST(Task_Graph_Test, RejectsUnknownDependencies) {
+    Task_Graph graph;
+    EXPECT_THROW(graph.add_task([]() {}, {0}), std::invalid_argument);
+    Task_Graph::Task_Id first = graph.add_task([]() {});
+    EXPECT_NO_THROW(graph.add_task([]() {}, {first}));
+    EXPECT_EQ(graph.size(), 2u);
+    EXPECT_NO_THROW(graph.run());
+}
+
+// A task whose dependency has finished runs before the roots still waiting in the queue
+TEST(Task_Graph_Test, DependentsRunBeforeQueuedRoots) {
+    const size_t n_roots = 8;
+    std::vector<int> order;
+    Task_Graph graph;
+    Task_Graph::Task_Id first = graph.add_task([&]() { order.push_back(0); });
+    for (size_t root = 1; root < n_roots; ++root) {
+        graph.add_task([&, root]() { order.push_back(static_cast<int>(root)); });
+    }
+    graph.add_task([&]() { order.push_back(-1); }, {first});
+    graph.run(1);
+
+    ASSERT_EQ(order.size(), n_roots + 1);
+    EXPECT_EQ(order[0], 0);
+    EXPECT_EQ(order[1], -1);
+}
@@ -2,9 +2,13 @@
 #include "gtest/gtest.h"
 #include <algorithm>
 #include <list>
+#include <random>
 #include <string>
 #include <vector>
 #include "volatility_formula.h"
+#include "volatility_parse.h"
+#include "stock_manager.h"
+#include "portfolio_manager.h"
 
 namespace VolatilityFunctions {
     
@@ -60,4 +64,173 @@ namespace VolatilityFunctions {
         EXPECT_NEAR(updated_volatility, expected_updated_volatility, 0.001);
     }
 
+    TEST(VolatilityFunctionsTest, ParkinsonVariance) {
+        double high = 110.0;
+        double low = 100.0;
+
+        double range = log(high / low);
+        double expected_variance = range * range / (4.0 * log(2.0));
+
+        EXPECT_NEAR(parkinson_variance(high, low), expected_variance, 1e-12);
+        EXPECT_EQ(parkinson_variance(100.0, 100.0), 0.0);
+    }
+
+    TEST(VolatilityFunctionsTest, GarmanKlassVariance) {
+        double open = 100.0, high = 110.0, low = 95.0, close = 105.0;
+
+        double range = log(high / low);
+        double move = log(close / open);
+        double expected_variance = 0.5 * range * range - (2.0 * log(2.0) - 1.0) * move * move;
+
+        EXPECT_NEAR(garman_klass_variance(open, high, low, close), expected_variance, 1e-12);
+        // Without an open-close move it is half the squared range
+        EXPECT_NEAR(garman_klass_variance(100.0, 110.0, 100.0, 100.0), 0.5 * std::pow(log(1.1), 2.0), 1e-12);
+    }
+
+    // The view-based kernels must match the vector path exactly, for data they do not own
+
+    TEST(Series_View_Test, VolatilityAlgorithmMatchesStoredReturns) {
+        std::vector<double> prices = {100.0, 100.4, 99.8, 100.9, 101.3, 100.7, 100.2, 101.1};
+        std::vector<double> log_returns = logarithmic_return_function(prices);
+        EXPECT_EQ(volatility_algorithm(prices), volatility(log_returns, average_return(log_returns)));
+
+        std::vector<float> float_prices(prices.begin(), prices.end());
+        std::vector<float> float_returns = logarithmic_return_function(float_prices);
+        EXPECT_EQ(volatility_algorithm(float_prices), volatility(float_returns, average_return(float_returns)));
+    }
+
+    TEST(Series_View_Test, PooledBuffersMatchVectors) {
+        // Every ticker's prices live in one pooled buffer, as they would in a memory-mapped file
+        Ticker_Series prices = {{100.0, 101.0, 100.5, 102.0, 101.0, 101.5, 103.0, 102.5},
+                                {50.0, 49.0},
+                                {20.0, 20.2, 20.1, 20.4, 20.3, 20.6, 20.5}};
+        std::vector<double> pool;
+        for (const auto& series : prices) {
+            pool.insert(pool.end(), series.begin(), series.end());
+        }
+        std::vector<Series_View<double>> views;
+        size_t offset = 0;
+        for (const auto& series : prices) {
+            views.push_back(Series_View<double>(pool).subspan(offset, series.size()));
+            offset += series.size();
+        }
+        Ticker_Series_View<double> pooled(views);
+        Symbol_Table symbols;
+        for (const std::string ticker : {"A", "B", "C"}) {
+            symbols.intern(ticker);
+        }
+
+        std::vector<double> initial = ticker_to_vol_hourly(prices, symbols);
+        std::vector<double> pooled_initial(3);
+        ticker_to_vol_hourly(pooled, symbols, std::span<double>(pooled_initial));
+        EXPECT_EQ(pooled_initial[0], initial[0]);
+        EXPECT_TRUE(std::isnan(pooled_initial[1]));
+        EXPECT_EQ(pooled_initial[2], initial[2]);
+
+        Ticker_Series volatility = true_volatility(prices, initial, symbols);
+        Ticker_Series pooled_volatility = true_volatility(pooled, pooled_initial, symbols);
+        EXPECT_EQ(pooled_volatility, volatility);
+        EXPECT_EQ(calculate_percentage_changes(pooled), calculate_percentage_changes(prices));
+
+        // A reused output keeps its memory
+        Ticker_Series changes;
+        calculate_percentage_changes(pooled, changes);
+        const double* first_changes = changes[0].data();
+        calculate_percentage_changes(pooled, changes);
+        EXPECT_EQ(changes[0].data(), first_changes);
+    }
+
+    // Float32 series must stay within these bounds of the double path
+
+    // Random-walk hourly prices starting at 100, one series per hourly volatility
+    Ticker_Series random_walk_prices(const std::vector<double>& hourly_volatilities, size_t hours) {
+        std::mt19937 generator(7);
+        std::normal_distribution<double> move(0.0, 1.0);
+        Ticker_Series prices(hourly_volatilities.size());
+        for (size_t ticker = 0; ticker < prices.size(); ++ticker) {
+            double price = 100.0;
+            for (size_t hour = 0; hour < hours; ++hour) {
+                price *= std::exp(hourly_volatilities[ticker] * move(generator));
+                prices[ticker].push_back(price);
+            }
+        }
+        return prices;
+    }
+
+    TEST(Float32_Accuracy_Test, VolatilityAlgorithm) {
+        std::vector<double> prices = {100.0, 100.4, 99.8, 100.9, 101.3, 100.7};
+        std::vector<float> float_prices(prices.begin(), prices.end());
+
+        double expected = volatility_algorithm(prices);
+        float result = volatility_algorithm(float_prices);
+
+        EXPECT_NEAR(result, expected, 1e-4 * expected);
+    }
+
+    TEST(Float32_Accuracy_Test, EwmaChain) {
+        Ticker_Series prices = random_walk_prices({0.005}, 5000);
+        std::vector<float> float_prices(prices[0].begin(), prices[0].end());
+
+        double volatility_double = 0.005;
+        float volatility_float = 0.005f;
+        double max_relative_error = 0.0;
+        for (size_t i = 1; i < prices[0].size(); ++i) {
+            volatility_double = update_volatility(volatility_double, prices[0][i], prices[0][i - 1], 0.94);
+            volatility_float = update_volatility(volatility_float, float_prices[i], float_prices[i - 1], 0.94);
+            max_relative_error = std::max(max_relative_error, std::abs(volatility_float - volatility_double) / volatility_double);
+        }
+
+        // Rounding the prices to float dominates; it does not accumulate through the EWMA
+        EXPECT_LT(max_relative_error, 2e-3);
+    }
+
+    TEST(Float32_Accuracy_Test, PercentageChanges) {
+        Ticker_Series prices = random_walk_prices({0.002, 0.005, 0.005, 0.01}, 2000);
+        Float_Ticker_Series float_prices = convert_ticker_series<float>(prices);
+
+        Ticker_Series expected = calculate_percentage_changes(prices);
+        Float_Ticker_Series result = calculate_percentage_changes(float_prices);
+
+        ASSERT_EQ(result.size(), expected.size());
+        for (size_t ticker = 0; ticker < expected.size(); ++ticker) {
+            ASSERT_EQ(result[ticker].size(), expected[ticker].size());
+            for (size_t i = 0; i < expected[ticker].size(); ++i) {
+                // Percent points; float prices around 100 carry about 1e-5 absolute error
+                EXPECT_NEAR(result[ticker][i], expected[ticker][i], 1e-3);
+            }
+        }
+    }
+
+    TEST(Float32_Accuracy_Test, ManagersMatchDoublePath) {
+        // Volatilities away from the strategy thresholds (0.0025 to 0.004), so both paths make the same decisions
+        Ticker_Series prices = random_walk_prices({0.001, 0.0015, 0.002, 0.006, 0.008, 0.01}, 1500);
+        Float_Ticker_Series float_prices = convert_ticker_series<float>(prices);
+        Symbol_Table symbols;
+        for (size_t ticker = 0; ticker < prices.size(); ++ticker) {
+            symbols.intern("T" + std::to_string(ticker));
+        }
+
+        Ticker_Series volatility = true_volatility(prices, ticker_to_vol_hourly(prices, symbols), symbols);
+        Float_Ticker_Series float_volatility = true_volatility(float_prices, ticker_to_vol_hourly(float_prices, symbols), symbols);
+        Ticker_Series changes = calculate_percentage_changes(prices);
+        Float_Ticker_Series float_changes = calculate_percentage_changes(float_prices);
+
+        for (const std::string strategy : {"optimistic", "neutral", "conservative"}) {
+            std::vector<double> portfolio(prices.size(), 1000.0);
+            std::vector<double> float_portfolio(prices.size(), 1000.0);
+
+            Stock_Manager_Result decisions = stock_manager(volatility, portfolio, strategy);
+            Stock_Manager_Result float_decisions = stock_manager(float_volatility, float_portfolio, strategy);
+            EXPECT_EQ(float_decisions.buying_stocks, decisions.buying_stocks);
+            EXPECT_EQ(float_decisions.selling_stocks, decisions.selling_stocks);
+            EXPECT_GT(decisions.reallocation_funds.back(), 0.0);
+
+            portfolio_manager(decisions.buying_stocks, decisions.reallocation_funds, portfolio, strategy, volatility, changes);
+            portfolio_manager(float_decisions.buying_stocks, float_decisions.reallocation_funds, float_portfolio, strategy, float_volatility, float_changes);
+            for (size_t ticker = 0; ticker < portfolio.size(); ++ticker) {
+                EXPECT_NEAR(float_portfolio[ticker], portfolio[ticker], 1e-3 * portfolio[ticker]) << strategy << " ticker " << ticker;
+            }
+        }
+    }
+
 }
\ No newline at end of file